@@ -0,0 +1,409 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "symbols.h"
+#include "memoryImage.h"
+#include "instructions.h"
+#include "analyzer.h"
+
+#define MAX_CYCLES_LINE 80
+#define LOAD_USE "load-use"
+
+/* How control goes on after an instruction */
+enum Flow {FLOW_NEXT, FLOW_BRANCH, FLOW_JUMP, FLOW_CALL, FLOW_STOP};
+
+static long *cycles; /* Estimated cycles of every instruction, by index */
+static long loadUseCycles; /* Stall of an instruction using the register loaded right before it */
+
+static const char *loads[] = {"lb", "lh", "lw", NULL};
+static const char *stores[] = {"sb", "sh", "sw", NULL};
+
+/* Returns non-zero if the name of instruction 'index' is one of 'names', which ends with NULL */
+int isOneOf(int index, const char **names) {
+	for (; *names; names++)
+		if (!strcmp(instructionName(index), *names))
+			return 1;
+	return 0;
+}
+
+/* Sets the cycle estimate of every instruction to 1, and of a load-use stall to 1. Then reads changes from 'filename', unless
+ * it is NULL. Every line is an instruction name or "load-use", and a number of cycles. Text after ';' is a comment.
+ * Returns non-zero on error. */
+int prepareAnalysis(const char *filename) {
+	FILE *f;
+	char line[MAX_CYCLES_LINE + 2], name[MAX_CYCLES_LINE + 1], *comment, extra;
+	long value;
+	int i, fields, lineNumber = 0, error = 0;
+	Symbol *s;
+
+	prepareDecoding();
+	free(cycles);
+	if (!(cycles = (long *) malloc(instructionNumber() * sizeof (long)))) {
+		printf("Error: Could not allocate required memory\n");
+		return 1;
+	}
+	for (i = 0; i < instructionNumber(); i++)
+		cycles[i] = 1;
+	loadUseCycles = 1;
+	if (filename == NULL)
+		return 0;
+	if (!(f = fopen(filename, "r"))) {
+		printf("Error: Could not open '%s'\n", filename);
+		return 1;
+	}
+	while (fgets(line, sizeof line, f)) {
+		lineNumber++;
+		if ((comment = strchr(line, ';')))
+			*comment = '\0';
+		if ((fields = sscanf(line, "%80s %ld %c", name, &value, &extra)) <= 0) /* Blank line */
+			continue;
+		if (fields != 2 || value < 0) {
+			printf("Error on line %d of '%s': Expected an instruction and a number of cycles\n", lineNumber, filename);
+			error = 1;
+		}
+		else if (!strcmp(name, LOAD_USE))
+			loadUseCycles = value;
+		else if ((s = lookupSymbol(name)) && hasAttribute(s, INSTRUCTION_KEYWORD))
+			cycles[s->value] = value;
+		else {
+			printf("Error on line %d of '%s': No such instruction '%s'\n", lineNumber, filename, name);
+			error = 1;
+		}
+	}
+	fclose(f);
+	return error;
+}
+
+enum Flow instructionFlow(unsigned long word) {
+	int index;
+	long value;
+	if ((index = decodeInstruction(word)) < 0)
+		return FLOW_NEXT;
+	if (findParam(index, word, PARAM_INTERNAL_LABEL, &value) >= 0)
+		return FLOW_BRANCH;
+	if (!strcmp(instructionName(index), "jmp"))
+		return FLOW_JUMP;
+	if (!strcmp(instructionName(index), "call"))
+		return FLOW_CALL;
+	if (!strcmp(instructionName(index), "stop"))
+		return FLOW_STOP;
+	return FLOW_NEXT;
+}
+
+/* Returns the register param an instruction writes, or -1 if it writes none. It is the last register of every instruction
+ * other than branches, stores and jumps. */
+int writtenParam(int index, unsigned long word) {
+	int i, last = -1;
+	long value;
+	if (findParam(index, word, PARAM_INTERNAL_LABEL, &value) >= 0 || isOneOf(index, stores) || !strcmp(instructionName(index), "jmp"))
+		return -1;
+	for (i = 0; i < instructionParamNumber(index); i++)
+		if (decodeParam(index, i, word, &value) == PARAM_REGISTER)
+			last = i;
+	return last;
+}
+
+/* Returns non-zero if 'word' reads register 'reg' */
+int readsRegister(unsigned long word, long reg) {
+	int index, i, written;
+	long value;
+	if ((index = decodeInstruction(word)) < 0)
+		return 0;
+	written = writtenParam(index, word);
+	for (i = 0; i < instructionParamNumber(index); i++)
+		if (i != written && decodeParam(index, i, word, &value) == PARAM_REGISTER && value == reg)
+			return 1;
+	return 0;
+}
+
+/* Returns the index of the block containing 'address', or -1 if it is not in the code image */
+int findBlock(Analysis *a, int address) {
+	int low = 0, high = a->blockCount - 1, mid;
+	if (a->blockCount == 0 || address < a->blocks[0].address)
+		return -1;
+	while (low < high) { /* Last block starting at or before the address */
+		mid = (low + high + 1) / 2;
+		if (a->blocks[mid].address <= address)
+			low = mid;
+		else
+			high = mid - 1;
+	}
+	return address < a->blocks[low].address + a->blocks[low].count * WORD ? low : -1;
+}
+
+/* Deletes an analysis */
+void deleteAnalysis(Analysis *a) {
+	if (a) {
+		free(a->blocks);
+		free(a->hazards);
+		free(a);
+	}
+}
+
+/* Control flow graph of the blocks, for finding loops. Node 'count' is a virtual root, leading to every block that code may
+ * start running from: the first block, called blocks, and blocks no other block leads to. */
+typedef struct Graph {
+	Analysis *a;
+	int count;
+	int *predStart, *preds; /* Predecessors of block i are preds[predStart[i]] up to preds[predStart[i + 1]] */
+	unsigned char *fromRoot; /* Set for blocks the root leads to */
+	int *pre, *post, *idom; /* DFS numbers and immediate dominators */
+} Graph;
+
+/* Numbers the nodes in DFS order from the root, which leads to 'roots' first, then to any block still not reached */
+void numberNodes(Graph *g, int *roots, int rootCount, int *stack, int *next) {
+	int top = 0, node, child, preCount = 0, postCount = 0;
+	Block *b;
+
+	g->pre[g->count] = preCount++;
+	stack[top++] = g->count;
+	next[g->count] = 0;
+	while (top) {
+		node = stack[top - 1];
+		if (node == g->count) { /* Root: roots, then every block */
+			child = next[node] < rootCount ? roots[next[node]] : next[node] - rootCount < g->count ? next[node] - rootCount : -2;
+			if (child >= 0 && (next[node] < rootCount || g->pre[child] < 0))
+				g->fromRoot[child] = 1;
+		}
+		else {
+			b = &g->a->blocks[node];
+			child = next[node] < 2 ? b->successors[next[node]] : -2;
+		}
+		if (child == -2) {
+			g->post[node] = postCount++;
+			top--;
+			continue;
+		}
+		next[node]++;
+		if (child >= 0 && g->pre[child] < 0) {
+			g->pre[child] = preCount++;
+			next[child] = 0;
+			stack[top++] = child;
+		}
+	}
+}
+
+int intersect(Graph *g, int first, int second) {
+	while (first != second) {
+		while (g->post[first] < g->post[second])
+			first = g->idom[first];
+		while (g->post[second] < g->post[first])
+			second = g->idom[second];
+	}
+	return first;
+}
+
+/* Finds immediate dominators, iterating over the blocks in reverse postorder until nothing changes */
+void findDominators(Graph *g, int *order) {
+	int i, j, node, idom, changed;
+	for (i = 0; i <= g->count; i++) {
+		order[g->count - g->post[i]] = i; /* Reverse postorder, the root first */
+		g->idom[i] = -1;
+	}
+	g->idom[g->count] = g->count;
+	do {
+		changed = 0;
+		for (i = 1; i <= g->count; i++) {
+			node = order[i];
+			idom = g->fromRoot[node] ? g->count : -1;
+			for (j = g->predStart[node]; j < g->predStart[node + 1]; j++)
+				if (g->idom[g->preds[j]] >= 0)
+					idom = idom < 0 ? g->preds[j] : intersect(g, g->preds[j], idom);
+			if (idom != g->idom[node]) {
+				g->idom[node] = idom;
+				changed = 1;
+			}
+		}
+	} while (changed);
+}
+
+/* Returns non-zero if every path from the root to 'node' passes 'dominator' */
+int dominates(Graph *g, int dominator, int node) {
+	while (node != dominator && node != g->count)
+		node = g->idom[node];
+	return node == dominator;
+}
+
+/* Marks loop headers, and counts the loops containing every block. A loop is the blocks that reach a latch, a block going back
+ * to its dominating header, without passing the header. */
+void findLoops(Graph *g, int *stack, int *mark) {
+	int header, i, j, top, node, pred;
+	for (i = 0; i < g->count; i++)
+		mark[i] = -1;
+	for (header = 0; header < g->count; header++) {
+		mark[header] = header;
+		for (i = g->predStart[header], top = 0; i < g->predStart[header + 1]; i++) {
+			pred = g->preds[i];
+			/* Only an edge to a DFS ancestor can be a back edge, so dominance is checked for few edges */
+			if (g->pre[header] <= g->pre[pred] && g->post[pred] <= g->post[header] && dominates(g, header, pred)) {
+				g->a->blocks[header].loop = 1;
+				if (mark[pred] != header) {
+					mark[pred] = header;
+					stack[top++] = pred;
+				}
+			}
+		}
+		if (!g->a->blocks[header].loop)
+			continue;
+		g->a->blocks[header].depth++;
+		while (top) {
+			node = stack[--top];
+			g->a->blocks[node].depth++;
+			for (j = g->predStart[node]; j < g->predStart[node + 1]; j++)
+				if (mark[g->preds[j]] != header) {
+					mark[g->preds[j]] = header;
+					stack[top++] = g->preds[j];
+				}
+		}
+	}
+}
+
+/* Returns the block that starts at 'address', or -1 if the address is not of a word in the code image */
+int blockAt(int *blockOf, int wordCount, long address) {
+	if (address < CODE_START || address >= CODE_START + (long) wordCount * WORD || (address - CODE_START) % WORD)
+		return -1;
+	return blockOf[(address - CODE_START) / WORD];
+}
+
+/* Builds the basic blocks and control flow graph of 'code', a code image of 'size' bytes, and estimates their cost.
+ * 'labels' are buffered symbols, of which code labels start blocks. Returns NULL on memory failure. */
+Analysis *analyzeCode(const unsigned char *code, int size, Symbol *labels) {
+	Analysis *a;
+	Graph g;
+	Block *b;
+	unsigned long *words;
+	unsigned char *leader;
+	int *blockOf, *roots, *stack, *next, *order;
+	int wordCount = size / WORD, i, j, index, rootCount = 0, target;
+	long reg;
+	enum Flow flow;
+
+	a = (Analysis *) calloc(1, sizeof (Analysis));
+	words = (unsigned long *) malloc((wordCount + 1) * sizeof (unsigned long));
+	leader = (unsigned char *) calloc(wordCount + 1, 1);
+	blockOf = (int *) malloc((wordCount + 1) * sizeof (int));
+	if (!(a && words && leader && blockOf)) {
+		free(a);
+		free(words);
+		free(leader);
+		free(blockOf);
+		return NULL;
+	}
+
+	/* Blocks start at the first word, labels, targets, and after control flow instructions */
+	for (i = 0; i < wordCount; i++)
+		for (words[i] = 0, j = WORD - 1; j >= 0; j--)
+			words[i] = words[i] << 8 | code[i * WORD + j]; /* Little endian */
+	leader[0] = 1;
+	for (; labels; labels = labels->next)
+		if (hasAttribute(labels, CODE) && labels->value % WORD == 0 && labels->value >= 0 && labels->value < size)
+			leader[labels->value / WORD] = 1;
+	for (i = 0; i < wordCount; i++) {
+		if (instructionFlow(words[i]) == FLOW_NEXT)
+			continue;
+		leader[i + 1] = 1;
+		if ((target = (int) instructionTarget(words[i], CODE_START + (long) i * WORD)) >= CODE_START &&
+				target < CODE_START + size && (target - CODE_START) % WORD == 0)
+			leader[(target - CODE_START) / WORD] = 1;
+	}
+	for (i = 0; i < wordCount; i++)
+		a->blockCount += leader[i];
+
+	g.a = a;
+	g.count = a->blockCount;
+	a->blocks = (Block *) calloc(g.count + 1, sizeof (Block));
+	a->hazards = (Hazard *) malloc((wordCount + 1) * sizeof (Hazard));
+	roots = (int *) malloc((2 * g.count + 1) * sizeof (int)); /* Called blocks, and blocks without predecessors */
+	stack = (int *) malloc((g.count + 1) * sizeof (int));
+	next = (int *) malloc((g.count + 1) * sizeof (int));
+	order = (int *) malloc((g.count + 1) * sizeof (int));
+	g.predStart = (int *) calloc(g.count + 2, sizeof (int));
+	g.preds = (int *) malloc((2 * g.count + 1) * sizeof (int));
+	g.fromRoot = (unsigned char *) calloc(g.count + 1, 1);
+	g.pre = (int *) malloc((g.count + 1) * sizeof (int));
+	g.post = (int *) malloc((g.count + 1) * sizeof (int));
+	g.idom = (int *) malloc((g.count + 1) * sizeof (int));
+	if (a->blocks && a->hazards && roots && stack && next && order && g.predStart && g.preds && g.fromRoot && g.pre && g.post && g.idom) {
+		/* Count instructions, cycles and hazards of every block */
+		for (i = 0, b = a->blocks - 1; i < wordCount; i++) {
+			if (leader[i]) {
+				(++b)->address = CODE_START + i * WORD;
+				b->successors[0] = b->successors[1] = -1;
+			}
+			blockOf[i] = b - a->blocks;
+			b->count++;
+			b->cycles += (index = decodeInstruction(words[i])) >= 0 ? cycles[index] : 1;
+			if (index >= 0 && isOneOf(index, loads) && i + 1 < wordCount &&
+					decodeParam(index, writtenParam(index, words[i]), words[i], &reg) == PARAM_REGISTER && readsRegister(words[i + 1], reg)) {
+				b->hazards++;
+				b->cycles += loadUseCycles;
+				a->hazards[a->hazardCount].address = CODE_START + i * WORD;
+				a->hazards[a->hazardCount++].reg = (int) reg;
+			}
+		}
+
+		/* Edges, from the last instruction of every block */
+		for (i = 0; i < g.count; i++) {
+			b = &a->blocks[i];
+			j = (b->address - CODE_START) / WORD + b->count - 1;
+			flow = instructionFlow(words[j]);
+			target = blockAt(blockOf, wordCount, instructionTarget(words[j], b->address + (b->count - 1) * WORD));
+			if ((flow == FLOW_NEXT || flow == FLOW_BRANCH || flow == FLOW_CALL) && i + 1 < g.count)
+				b->successors[0] = i + 1;
+			if (flow == FLOW_BRANCH && target != b->successors[0])
+				b->successors[1] = target;
+			else if (flow == FLOW_JUMP) {
+				b->successors[0] = target;
+				b->indirect = target < 0 && findParam(decodeInstruction(words[j]), words[j], PARAM_REGISTER, &reg) >= 0;
+			}
+			else if (flow == FLOW_CALL && target >= 0)
+				roots[rootCount++] = target; /* Called code is entered from elsewhere */
+			for (j = 0; j < 2; j++)
+				if (b->successors[j] >= 0)
+					g.predStart[b->successors[j] + 2]++;
+		}
+
+		/* Predecessor lists, and loops */
+		for (i = 0; i < g.count; i++) {
+			g.predStart[i + 2] += g.predStart[i + 1];
+			g.pre[i] = -1;
+		}
+		for (i = 0; i < g.count; i++)
+			for (j = 0; j < 2; j++)
+				if ((target = a->blocks[i].successors[j]) >= 0)
+					g.preds[g.predStart[target + 1]++] = i;
+		for (i = 0; i < g.count; i++)
+			if (i == 0 || g.predStart[i + 1] == g.predStart[i])
+				roots[rootCount++] = i;
+		g.pre[g.count] = -1;
+		if (g.count > 0) {
+			numberNodes(&g, roots, rootCount, stack, next);
+			findDominators(&g, order);
+			findLoops(&g, stack, next);
+		}
+
+		a->count = wordCount;
+		for (i = 0; i < g.count; i++)
+			a->cycles += a->blocks[i].cycles;
+	}
+	else {
+		deleteAnalysis(a);
+		a = NULL;
+	}
+
+	free(words);
+	free(leader);
+	free(blockOf);
+	free(roots);
+	free(stack);
+	free(next);
+	free(order);
+	free(g.predStart);
+	free(g.preds);
+	free(g.fromRoot);
+	free(g.pre);
+	free(g.post);
+	free(g.idom);
+	return a;
+}
@@ -0,0 +1,47 @@
+#ifndef ANALYZER
+#define ANALYZER
+
+#include "symbols.h"
+
+/* A basic block: instructions that always run one after the other, entered only at the first */
+typedef struct Block {
+	int address; /* Address of the first instruction */
+	int count; /* Number of instructions */
+	long cycles; /* Estimated cycles, including load-use stalls */
+	int hazards; /* Load-use hazards of loads in the block */
+	int successors[2]; /* Indices of blocks that may run next, or -1 */
+	int indirect; /* Set if it ends with a jump to a register, whose successor is unknown */
+	int loop; /* Set if a loop starts at the block */
+	int depth; /* Number of loops containing the block */
+} Block;
+
+/* A loaded register used by the next instruction, which stalls until the load completes */
+typedef struct Hazard {
+	int address; /* Address of the load */
+	int reg; /* The loaded register */
+} Hazard;
+
+typedef struct Analysis {
+	Block *blocks; /* Sorted by address */
+	int blockCount;
+	Hazard *hazards; /* Sorted by address */
+	int hazardCount;
+	int count; /* Number of instructions */
+	long cycles; /* Estimated cycles, for running every instruction once */
+} Analysis;
+
+/* Sets the cycle estimate of every instruction to 1, and of a load-use stall to 1. Then reads changes from 'filename', unless
+ * it is NULL. Returns non-zero on error. */
+int prepareAnalysis(const char *filename);
+
+/* Builds the basic blocks and control flow graph of 'code', a code image of 'size' bytes, and estimates their cost.
+ * 'labels' are buffered symbols, of which code labels start blocks. Returns NULL on memory failure. */
+Analysis *analyzeCode(const unsigned char *code, int size, Symbol *labels);
+
+/* Deletes an analysis */
+void deleteAnalysis(Analysis *a);
+
+/* Returns the index of the block containing 'address', or -1 if it is not in the code image */
+int findBlock(Analysis *a, int address);
+
+#endif
@@ -0,0 +1,230 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "instructions.h"
+#include "memoryImage.h"
+#include "grammar.h"
+
+#define OUT_EXTENS ".ob"
+#define ENT_EXTENS ".ent"
+#define EXT_EXTENS ".ext"
+
+#define BYTES_PER_ROW 4
+
+/* A label read from an .ent or .ext file, with its address */
+typedef struct Label {
+	char name[MAX_LABEL + 1];
+	int address;
+} Label;
+
+/* Labels sorted by address */
+typedef struct LabelTable {
+	Label *labels;
+	int count;
+	int next; /* Index of next label not yet passed while streaming */
+} LabelTable;
+
+int compareLabels(const void *a, const void *b) {
+	return ((const Label *) a)->address - ((const Label *) b)->address;
+}
+
+/* Reads the labels of 'basename' with 'extension' into 'table', sorted by address. A missing file is an empty table. Returns non-zero on memory failure. */
+int readLabels(LabelTable *table, const char *basename, const char *extension) {
+	FILE *f;
+	char *filename;
+	Label label, *tmp;
+	int capacity = 0;
+
+	table->labels = NULL;
+	table->count = table->next = 0;
+	if (!(filename = (char *) malloc(strlen(basename) + strlen(extension) + 1)))
+		return 1;
+	strcat(strcpy(filename, basename), extension);
+	f = fopen(filename, "r");
+	free(filename);
+	if (f == NULL)
+		return 0;
+	while (fscanf(f, "%31s %d", label.name, &label.address) == 2) {
+		if (table->count == capacity) {
+			capacity = capacity ? capacity * 2 : 16;
+			if (!(tmp = (Label *) realloc(table->labels, capacity * sizeof (Label)))) {
+				fclose(f);
+				return 1;
+			}
+			table->labels = tmp;
+		}
+		table->labels[table->count++] = label;
+	}
+	fclose(f);
+	qsort(table->labels, table->count, sizeof (Label), compareLabels);
+	return 0;
+}
+
+/* Returns the name of the label at 'address', or NULL if there is none */
+char *findLabel(LabelTable *table, int address) {
+	int low = 0, high = table->count - 1, mid;
+	while (low <= high) {
+		mid = (low + high) / 2;
+		if (table->labels[mid].address < address)
+			low = mid + 1;
+		else if (table->labels[mid].address > address)
+			high = mid - 1;
+		else
+			return table->labels[mid].name;
+	}
+	return NULL;
+}
+
+/* Prints the labels defined up to 'address', as they are passed while streaming */
+void printLabelsUpTo(LabelTable *entries, int address) {
+	while (entries->next < entries->count && entries->labels[entries->next].address <= address)
+		printf("%s:\n", entries->labels[entries->next++].name);
+}
+
+/* Prints a label operand by name if known, otherwise by address */
+void printAddress(LabelTable *entries, int address) {
+	char *name;
+	if ((name = findLabel(entries, address)))
+		printf("%s", name);
+	else
+		printf("%04d", address);
+}
+
+/* Prints the disassembly of the code word at 'address' */
+void printInstruction(unsigned long word, int address, LabelTable *entries, LabelTable *externs) {
+	int index, i, first = 1;
+	long value;
+	enum ParamKind kind;
+	char *name;
+
+	printf("%04d\t%08lX\t", address, word);
+	if ((index = decodeInstruction(word)) < 0) {
+		printf(".dw %ld\n", (long) word);
+		return;
+	}
+	printf("%s", instructionName(index));
+	for (i = 0; i < instructionParamNumber(index); i++) {
+		if ((kind = decodeParam(index, i, word, &value)) == PARAM_FIXED)
+			continue;
+		printf(first ? " " : ", ");
+		first = 0;
+		if (kind == PARAM_REGISTER)
+			printf("$%ld", value);
+		else if (kind == PARAM_CONSTANT)
+			printf("%ld", value);
+		else if (kind == PARAM_INTERNAL_LABEL)
+			printAddress(entries, address + (int) value);
+		else if ((name = findLabel(externs, address))) /* External label, used at this address */
+			printf("%s", name);
+		else
+			printAddress(entries, (int) value);
+	}
+	printf("\n");
+}
+
+/* Prints collected data bytes as a single '.db' directive */
+void printData(unsigned char *bytes, int count, int address) {
+	int i;
+	if (count == 0)
+		return;
+	printf("%04d\t\t\t.db", address);
+	for (i = 0; i < count; i++)
+		printf(i ? ", %d" : " %d", (signed char) bytes[i]);
+	printf("\n");
+}
+
+/* Streams the .ob file 'f' and prints its disassembly. Returns non-zero on a malformed file. */
+int disassemble(FILE *f, LabelTable *entries, LabelTable *externs) {
+	int codeSize, dataSize, address, i = 0, rowAddress, pending = 0, pendingAddress = 0;
+	unsigned int byte;
+	unsigned long word = 0;
+	unsigned char data[BYTES_PER_ROW];
+
+	if (fscanf(f, "%d %d", &codeSize, &dataSize) != 2 || codeSize % WORD || codeSize < 0 || dataSize < 0) {
+		printf("Error: Missing or invalid image sizes\n");
+		return 1;
+	}
+	while (i < codeSize + dataSize) {
+		if (i % BYTES_PER_ROW == 0) { /* Every row starts with its address */
+			if (fscanf(f, "%d", &rowAddress) != 1 || rowAddress != i + CODE_START) {
+				printf("Error: Expected address %04d\n", i + CODE_START);
+				return 1;
+			}
+		}
+		if (fscanf(f, "%2X", &byte) != 1) {
+			printf("Error: Expected byte at address %04d\n", i + CODE_START);
+			return 1;
+		}
+		address = i + CODE_START;
+		if (i < codeSize) {
+			word |= (unsigned long) byte << (i % WORD * 8); /* Little endian */
+			if (i % WORD == WORD - 1) {
+				printLabelsUpTo(entries, address - (WORD - 1));
+				printInstruction(word, address - (WORD - 1), entries, externs);
+				word = 0;
+			}
+		}
+		else {
+			if (pending == BYTES_PER_ROW || (entries->next < entries->count && entries->labels[entries->next].address <= address)) {
+				printData(data, pending, pendingAddress);
+				pending = 0;
+			}
+			printLabelsUpTo(entries, address);
+			if (pending == 0)
+				pendingAddress = address;
+			data[pending++] = (unsigned char) byte;
+		}
+		i++;
+	}
+	printData(data, pending, pendingAddress);
+	printLabelsUpTo(entries, codeSize + dataSize + CODE_START);
+	return 0;
+}
+
+int main(int argc, char *argv[]) {
+	FILE *f;
+	LabelTable entries, externs;
+	char *extension, *basename;
+	int error = 0;
+
+	if (argc == 1) {
+		printf("Error: No input files\n");
+		return 0;
+	}
+
+	prepareDecoding(); /* Build opcode tables from the instruction descriptors */
+
+	while (*++argv) {
+		if (!((extension = strrchr(*argv, OUT_EXTENS[0])) && !strcmp(extension, OUT_EXTENS))) {
+			printf("Error: '%s' does not have '%s' extension\n", *argv, OUT_EXTENS);
+			error = 1;
+			continue;
+		}
+		if (!(f = fopen(*argv, "r"))) {
+			printf("Error: Could not open '%s'\n", *argv);
+			error = 1;
+			continue;
+		}
+		if (!(basename = (char *) malloc(extension - *argv + 1))) {
+			printf("Error: Could not allocate required memory\n");
+			exit(1);
+		}
+		strncpy(basename, *argv, extension - *argv);
+		basename[extension - *argv] = '\0';
+		if (readLabels(&entries, basename, ENT_EXTENS) || readLabels(&externs, basename, EXT_EXTENS)) {
+			printf("Error: Could not allocate required memory\n");
+			exit(1);
+		}
+
+		printf("; %s\n", *argv);
+		error |= disassemble(f, &entries, &externs);
+
+		free(entries.labels);
+		free(externs.labels);
+		free(basename);
+		fclose(f);
+	}
+
+	return error;
+}
@@ -1,34 +1,105 @@
 #include <stdio.h>
+#include <string.h>
 
 #include "assembler.h"
 #include "symbols.h"
 #include "grammar.h"
+#include "instructions.h"
+#include "analyzer.h"
+#include "trace.h"
+
+#define CYCLES_OPTION "--cycles="
 
 int assembleFile(FILE *f);
 
+static int optimize; /* Run the optimizer on the code image */
+
 int main(int argc, char *argv[]) {
 	FILE *f;
-	
-	if (argc == 1) {
+	int outputs = 0, options = 0, languageServer = 0, error;
+	char *cyclesFile = NULL, *traceFile = NULL;
+	double start;
+
+	while (*++argv && **argv == '-') { /* Options come before input files */
+		if (!strcmp(*argv, "--sync"))
+			outputs |= OUTPUT_SYNC; /* Write every output before assembling the next file */
+		else if (!strcmp(*argv, "--natural-align"))
+			options |= NATURAL_ALIGN; /* Align .dh and .dw to their size */
+		else if (!strcmp(*argv, "--lsp"))
+			languageServer = 1; /* Serve editors instead of assembling files */
+		else if (!strcmp(*argv, "-O"))
+			optimize = 1; /* Remove no-ops and trivial branches */
+		else if (!strcmp(*argv, "--checksum"))
+			outputs |= OUTPUT_CHECKSUM; /* CRC32C of every output, in a .crc file */
+		else if (!strcmp(*argv, "--write-if-changed"))
+			outputs |= OUTPUT_IF_CHANGED; /* Leave outputs with the same content untouched */
+		else if (!strcmp(*argv, "--map"))
+			outputs |= OUTPUT_MAP; /* Binary symbol map and line table */
+		else if (!strcmp(*argv, "--map-text"))
+			outputs |= OUTPUT_MAP_TEXT; /* Same, as text */
+		else if (!strcmp(*argv, "--analyze"))
+			outputs |= OUTPUT_ANALYZE; /* Basic blocks, cycle estimates, hazards and loops of the code */
+		else if (!strncmp(*argv, CYCLES_OPTION, strlen(CYCLES_OPTION))) {
+			outputs |= OUTPUT_ANALYZE;
+			cyclesFile = *argv + strlen(CYCLES_OPTION); /* Cycles of instructions, for the analysis */
+		}
+		else if (!strcmp(*argv, "--trace")) {
+			if (!*++argv) {
+				printf("Error: Missing trace file after '--trace'\n");
+				return 1;
+			}
+			traceFile = *argv; /* Timeline of every file, for Chrome trace viewers */
+		}
+		else if (!strcmp(*argv, "--merge-strings"))
+			options |= MERGE_STRINGS; /* Share identical .asciz strings */
+		else
+			printf("Warn: Unknown option '%s' is ignored\n", *argv);
+	}
+	if (languageServer) {
+		prepareInstructions();
+		return runLanguageServer();
+	}
+	if (*argv == NULL) {
 		printf("Error: No input files\n");
 		return 0;
 	}
 
 	prepareInstructions(); /* Store language keywords in symbol table */
+	setParseOptions(options);
+	if (optimize)
+		prepareDecoding(); /* The optimizer decodes the code image */
+	if ((outputs & OUTPUT_ANALYZE) && prepareAnalysis(cyclesFile))
+		return 1;
+	if (traceFile && traceStart(traceFile))
+		printf("Warn: Could not start tracing\n");
+	traceThread("assembler");
+	outputStart(outputs); /* Write outputs in the background, while the next file is assembled */
 
-	while (*++argv) {
+	for (argv--; *++argv; ) {
 		printf((f = fopen(*argv, "r")) ? "Assembling %s:\n" : "Error: Could not open '%s'\n", *argv);
 		if (f != NULL) {
 			if (!validateFilename(*argv)) { /* Check input file and store it's name */
-				flushBuffers(assembleFile(f), *argv); /* Assemble the file and flush the output to files if no error occurred */
+				start = traceClock();
+				error = assembleFile(f);
+				traceSpan("assembleFile", *argv, start);
+				flushBuffers(error, *argv); /* Flush the output to files if no error occurred */
+				start = traceClock();
 				imageDelete(); /* Delete memory image */
+				poolDelete(); /* Delete pooled strings */
+				traceSpan("imageDelete", *argv, start);
+				start = traceClock();
 				deleteTable(CODE | DATA | EXTERNAL | ENTRY); /* Delete the user defined symbols */
+				traceSpan("deleteTable", *argv, start);
 			}
 			fclose(f); /* Close the assembled file */
 		}
 		printf("Done.\n");
 	}
 
+	start = traceClock();
+	outputFinish(); /* Wait for every output to be written */
+	traceSpan("outputFinish", NULL, start);
+	traceFinish();
 	deleteTable(INSTRUCTION_KEYWORD | DIRECTIVE_KEYWORD); /* Delete the keywords from the symbol table */
 
 	return 0;
@@ -36,11 +107,35 @@ int main(int argc, char *argv[]) {
 
 /* Assembles file 'f'. Returns non-zero on error. */
 int assembleFile(FILE *f) {
-	if (parse(f, PARSE_SYMBOLS))
+	int removed, error;
+	double start = traceClock();
+	error = parse(f, PARSE_SYMBOLS);
+	traceSpan("parse", "symbols", start);
+	if (error)
 		return 1;
-	if (imageAllocate()) {
+	start = traceClock();
+	error = imageAllocate();
+	traceSpan("imageAllocate", NULL, start);
+	if (error) {
 		printf("Error: Could not allocate required memory\n");
 		return 1;
 	}
-	return parse(f, PARSE_ALL);
+	if (getAlignPadding())
+		printf("Alignment inserted %d padding bytes\n", getAlignPadding());
+	start = traceClock();
+	error = parse(f, PARSE_ALL);
+	traceSpan("parse", "all", start);
+	if (error)
+		return 1;
+	if (optimize) {
+		start = traceClock();
+		removed = optimizeCode();
+		traceSpan("optimizeCode", NULL, start);
+		if (removed < 0) {
+			printf("Error: Could not allocate required memory\n");
+			return 1;
+		}
+		printf("Optimizer removed %d instructions\n", removed);
+	}
+	return 0;
 }
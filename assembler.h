@@ -1,6 +1,8 @@
 #ifndef ASSEMBLER
 #define ASSEMBLER
 
+enum OutputOption {OUTPUT_SYNC = 1, OUTPUT_MAP = 2, OUTPUT_MAP_TEXT = 4, OUTPUT_CHECKSUM = 8, OUTPUT_IF_CHANGED = 16, OUTPUT_ANALYZE = 32};
+
 /* Adds keywords to symbol table, so that they can't be redfined */
 void prepareInstructions(void);
 
@@ -10,10 +12,28 @@ int imageAllocate(void);
 /* Deletes allocated memory in memory image */
 void imageDelete(void);
 
+/* Deletes pooled strings of the assembled file */
+void poolDelete(void);
+
+/* Removes no-ops and trivial branches from the code image, and threads jumps to jumps. Returns the number of removed 
+ * instructions, or -1 on memory failure. prepareDecoding must have been called. */
+int optimizeCode(void);
+
+/* Serves the language server protocol on stdin and stdout, until 'exit'. Returns non-zero on failure. */
+int runLanguageServer(void);
+
 /* Extracts the filename with no extension from the full filename. Returns non-zero if the filename does not have the right extension. */
 int validateFilename(char *filenameFull);
 
 /* Deletes internal buffers storing data to be written to output. If error is 0, flushes the data into the output files. */
 void flushBuffers(int error, char *filename);
 
+/* Sets the outputs, a combination of OutputOption flags, and starts writing them in the background unless OUTPUT_SYNC is set.
+ * Returns non-zero if output will be written synchronously. */
+int outputStart(int options);
+
+/* Waits until every queued output has been written, and stops the background writer. Returns non-zero if an output could not be
+ * written. */
+int outputFinish(void);
+
 #endif
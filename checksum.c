@@ -0,0 +1,35 @@
+#include "checksum.h"
+
+#define CRC_POLYNOMIAL 0x82F63B78UL /* Castagnoli, reflected */
+#define CRC_MASK 0xFFFFFFFFUL
+#define SLICES 8
+
+static unsigned long crcTable[SLICES][256]; /* crcTable[k][b] is the CRC of byte b followed by k zero bytes */
+
+/* Builds the CRC32C tables. Must be called before checksum. */
+void prepareChecksum(void) {
+	int i, j;
+	unsigned long crc;
+	for (i = 0; i < 256; i++) {
+		for (crc = i, j = 0; j < 8; j++)
+			crc = (crc & 1) ? (crc >> 1) ^ CRC_POLYNOMIAL : crc >> 1;
+		crcTable[0][i] = crc;
+	}
+	for (i = 0; i < 256; i++)
+		for (j = 1; j < SLICES; j++)
+			crcTable[j][i] = (crcTable[j - 1][i] >> 8) ^ crcTable[0][crcTable[j - 1][i] & 0xFF];
+}
+
+/* Continues the CRC32C 'crc' (0 to start) over 'length' bytes at 'data', and returns it */
+unsigned long checksum(unsigned long crc, const unsigned char *data, long length) {
+	unsigned long low;
+	crc = ~crc & CRC_MASK;
+	for (; length >= SLICES; data += SLICES, length -= SLICES) { /* Eight bytes per step, one table lookup each */
+		low = crc ^ (data[0] | (unsigned long) data[1] << 8 | (unsigned long) data[2] << 16 | (unsigned long) data[3] << 24);
+		crc = crcTable[7][low & 0xFF] ^ crcTable[6][(low >> 8) & 0xFF] ^ crcTable[5][(low >> 16) & 0xFF] ^ crcTable[4][low >> 24] ^
+				crcTable[3][data[4]] ^ crcTable[2][data[5]] ^ crcTable[1][data[6]] ^ crcTable[0][data[7]];
+	}
+	while (length-- > 0)
+		crc = (crc >> 8) ^ crcTable[0][(crc ^ *data++) & 0xFF];
+	return ~crc & CRC_MASK;
+}
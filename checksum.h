@@ -0,0 +1,10 @@
+#ifndef CHECKSUM
+#define CHECKSUM
+
+/* Builds the CRC32C tables. Must be called before checksum. */
+void prepareChecksum(void);
+
+/* Continues the CRC32C 'crc' (0 to start) over 'length' bytes at 'data', and returns it */
+unsigned long checksum(unsigned long crc, const unsigned char *data, long length);
+
+#endif
@@ -17,18 +17,39 @@ int validateFilename(const char *filename) {
 	return 1;
 }
 
-/* Opens a file with the specified extension */
-FILE *createOutFile(const char *filename, const char *extension) {
+/* Returns a copy of the last validated filename without its extension, or NULL on memory failure */
+char *copyBasename(const char *filename) {
+	char *tmp;
+	if ((tmp = (char *) malloc(filenameLength + 1))) {
+		strncpy(tmp, filename, filenameLength);
+		tmp[filenameLength] = '\0';
+	}
+	return tmp;
+}
+
+/* Opens a file named 'basename' with the specified extension for writing. Returns NULL if it can't be created. Prints nothing,
+ * since it is called from the writer thread. */
+FILE *createOutFile(const char *basename, const char *extension) {
+	FILE *f = NULL;
+	char *tmp;
+	if ((tmp = (char *) malloc(strlen(basename) + strlen(extension) + 1))) {
+		strcpy(tmp, basename); /* Copy filename excluding extension */
+		strcat(tmp, extension); /* Copy extension to end of filename */
+		f = fopen(tmp, "w");
+		free(tmp);
+	}
+	return f;
+}
+
+/* Opens an existing file named 'basename' with the specified extension for reading. Returns NULL if it can't be read. */
+FILE *openOutFile(const char *basename, const char *extension) {
 	FILE *f = NULL;
 	char *tmp;
-	if ((tmp = (char *) malloc(filenameLength + strlen(extension) + 1))) {
-		strncpy(tmp, filename, filenameLength); /* Copy filename excluding extension */
-		strcpy(tmp + filenameLength, extension); /* Copy extension to end of filename */
-		if (!(f = fopen(tmp, "w")))
-			printf("Error: Could not create output file '%s'\n", tmp);
+	if ((tmp = (char *) malloc(strlen(basename) + strlen(extension) + 1))) {
+		strcpy(tmp, basename);
+		strcat(tmp, extension);
+		f = fopen(tmp, "rb");
 		free(tmp);
 	}
-	else
-		printf("Warn: Could not allocate required memory\n");
 	return f;
 }
@@ -2,15 +2,26 @@
 #include <string.h>
 #include <errno.h>
 #include <ctype.h>
+#include <limits.h>
 
 #include "symbols.h"
 #include "memoryImage.h"
 #include "grammar.h"
 #include "grammarHelper.h"
+#include "stringPool.h"
 
 void buffer(Symbol *copy);
+void bufferLine(int address, int lineNumber);
 int parseInstruction(int instructionIndex, char **p_line, int lineNumber);
 
+static int parseOptions; /* ParseOption flags */
+static int alignPadding; /* Padding bytes inserted in the first pass */
+
+/* Sets the optional parsing behaviours, a combination of ParseOption flags */
+void setParseOptions(int options) {
+	parseOptions = options;
+}
+
 /* Prepares for instruction parsing. On error returns non-zero. */
 int preInstruction(enum ParseMode mode, char *p_tmp, char **p_line, int lineNumber) {
 	Symbol *s;
@@ -70,6 +81,184 @@ int writeData(enum ParseMode mode, char **p_line, int lineNumber, enum Type type
 	return 0;
 }
 
+/* Reads a number for a reservation directive into 'value'. On error returns non-zero. */
+int readReserveParam(char **p_line, int lineNumber, long *value, char *name) {
+	char *p_tmp;
+	errno = 0;
+	*value = strtol(*p_line, &p_tmp, NUMBER_BASE);
+	if (*p_line == p_tmp || errno == ERANGE) {
+		printf("Error on line %d: Missing %s\n", lineNumber, name);
+		return 1;
+	}
+	*p_line = p_tmp;
+	Spacing(p_line);
+	return 0;
+}
+
+/* Reserves space in the data image for '.space count' or '.fill count, size, value' in one step. On error returns non-zero. */
+int reserveData(enum ParseMode mode, char **p_line, int lineNumber, enum StateAction action) {
+	long count, size = BYTE, value = 0;
+
+	if (readReserveParam(p_line, lineNumber, &count, "count"))
+		return 1;
+	if (action == ReserveFill) {
+		if (*(*p_line)++ != ',') {
+			printf("Error on line %d: Expected comma after parameter\n", lineNumber);
+			return 1;
+		}
+		Spacing(p_line);
+		if (readReserveParam(p_line, lineNumber, &size, "size"))
+			return 1;
+		if (*(*p_line)++ != ',') {
+			printf("Error on line %d: Expected comma after parameter\n", lineNumber);
+			return 1;
+		}
+		Spacing(p_line);
+		if (readReserveParam(p_line, lineNumber, &value, "value"))
+			return 1;
+		if (size != BYTE && size != HALF && size != WORD) {
+			printf("Error on line %d: Fill size must be %d, %d or %d\n", lineNumber, BYTE, HALF, WORD);
+			return 1;
+		}
+	}
+	if (mode == PARSE_SYMBOLS) {
+		if (count < 0 || count > (INT_MAX - imageSize(DATA_IMAGE)) / size) {
+			printf("Error on line %d: Invalid reservation count\n", lineNumber);
+			return 1;
+		}
+		imageReserve(DATA_IMAGE, (enum Type) size, (int) count);
+	}
+	else
+		imageFill(DATA_IMAGE, value, (int) size, (int) count);
+	return 0;
+}
+
+/* Writes a complete string, sharing the space of an identical earlier string or suffix. 'label' is the line's data label, or NULL. */
+void mergeString(enum ParseMode mode, char *string, int length, Symbol *label) {
+	int offset;
+	if (mode == PARSE_SYMBOLS) {
+		if ((offset = poolString(string, length, imageSize(DATA_IMAGE))) == POOL_ERROR) {
+			printf("Error: Could not allocate required memory\n");
+			exit(1);
+		}
+		if (offset == POOL_NEW)
+			imageReserve(DATA_IMAGE, BYTE, length + 1); /* Space for string and terminator */
+		else if (label)
+			label->value = offset; /* Point the label at the earlier copy */
+	}
+	else if (poolNextIsNew()) {
+		imageWriteArray(DATA_IMAGE, string, length);
+		imageWriteBytes(DATA_IMAGE, '\0', BYTE);
+	}
+}
+
+/* Returns the value of hex digit 'c' */
+int hexValue(char c) {
+	return isdigit((unsigned char) c) ? c - '0' : tolower((unsigned char) c) - 'a' + 10;
+}
+
+/* Decodes the quoted string at *p_line into 'string', and returns its length, or -1 on error. The closing quote is the last
+ * character of the line other than spaces, so the quotes before it belong to the string. Escapes are \n \t \\ \" \0 and \xNN. */
+int readString(char **p_line, int lineNumber, char *string) {
+	char *p = *p_line, *close, *run;
+	int length = 0, i;
+
+	if (*p != '"') {
+		printf("Error on line %d: String must begin with quotation marks\n", lineNumber);
+		return -1;
+	}
+	for (close = p + strlen(p); close > p + 1 && isspace((unsigned char) close[-1]); close--);
+	if (close == p + 1 || close[-1] != '"') {
+		printf("Error on line %d: String must be closed with quotation marks\n", lineNumber);
+		return -1;
+	}
+	for (close--, p++; p < close; ) {
+		if (!(run = (char *) memchr(p, '\\', close - p))) /* Copy up to the next escape in one piece */
+			run = close;
+		for (i = 0; i < run - p; i++) {
+			if (!isprint((unsigned char) p[i])) {
+				printf("Error on line %d: String can't contain non-printable characters\n", lineNumber);
+				return -1;
+			}
+		}
+		memcpy(string + length, p, run - p);
+		length += run - p;
+		if ((p = run) == close)
+			break;
+		if (++p == close) { /* The closing quote was escaped */
+			printf("Error on line %d: String must be closed with quotation marks\n", lineNumber);
+			return -1;
+		}
+		switch (*p++) {
+			case 'n': string[length++] = '\n'; break;
+			case 't': string[length++] = '\t'; break;
+			case '\\': string[length++] = '\\'; break;
+			case '"': string[length++] = '"'; break;
+			case '0': string[length++] = '\0'; break;
+			case 'x':
+				if (close - p < 2 || !isxdigit((unsigned char) p[0]) || !isxdigit((unsigned char) p[1])) {
+					printf("Error on line %d: Expected two hex digits after '\\x'\n", lineNumber);
+					return -1;
+				}
+				string[length++] = (char) (hexValue(p[0]) * 16 + hexValue(p[1]));
+				p += 2;
+				break;
+			default:
+				printf("Error on line %d: Unknown escape sequence '\\%c' in string\n", lineNumber, isprint((unsigned char) p[-1]) ? p[-1] : '?');
+				return -1;
+		}
+	}
+	*p_line = close + 1;
+	return length;
+}
+
+/* Writes the string of a string directive with its terminator, or reserves their space in the first pass. 'label' is the line's 
+ * data label, or NULL. Returns non-zero on error. */
+int writeString(enum ParseMode mode, char **p_line, int lineNumber, Symbol *label) {
+	char string[MAX_LINE + 1];
+	int length;
+	if ((length = readString(p_line, lineNumber, string)) < 0)
+		return 1;
+	if (parseOptions & MERGE_STRINGS)
+		mergeString(mode, string, length, label);
+	else if (mode == PARSE_SYMBOLS)
+		imageReserve(DATA_IMAGE, BYTE, length + 1); /* Space for string and terminator */
+	else {
+		imageWriteArray(DATA_IMAGE, string, length);
+		imageWriteBytes(DATA_IMAGE, '\0', BYTE);
+	}
+	return 0;
+}
+
+/* Pads the data image to a multiple of 'alignment' bytes, at most MAX_ALIGN, from its start, which also aligns the address. 'label' is the line's data label, or NULL. */
+void alignData(enum ParseMode mode, int alignment, Symbol *label) {
+	int padding;
+	if (mode == PARSE_SYMBOLS) {
+		padding = (alignment - imageSize(DATA_IMAGE) % alignment) % alignment;
+		imageReserve(DATA_IMAGE, BYTE, padding);
+		alignPadding += padding;
+		if (label)
+			label->value = imageSize(DATA_IMAGE); /* The label points to the aligned data */
+	}
+	else {
+		padding = (alignment - imageCurrent(DATA_IMAGE) % alignment) % alignment;
+		imageFill(DATA_IMAGE, 0, BYTE, padding);
+	}
+}
+
+/* Aligns the data image to the parameter of '.align'. On error returns non-zero. */
+int alignToParameter(enum ParseMode mode, char **p_line, int lineNumber, Symbol *label) {
+	long alignment;
+	if (readReserveParam(p_line, lineNumber, &alignment, "alignment"))
+		return 1;
+	if (alignment <= 0 || alignment > MAX_ALIGN || (alignment & (alignment - 1))) {
+		printf("Error on line %d: Alignment must be a power of 2 up to %d\n", lineNumber, MAX_ALIGN);
+		return 1;
+	}
+	alignData(mode, (int) alignment, label);
+	return 0;
+}
+
 /* Set the symbol to 'entry'. On error returns non-zero. */
 int doSetEntrySymbol(enum ParseMode mode, char *p_line, char *p_tmp, int lineNumber) {
 	char tmp = *p_line;
@@ -119,8 +308,10 @@ enum Type getSizeType(int state) {
 		case WriteByte:
 			return BYTE;
 		case WriteHalf:
+		case AlignHalf:
 			return HALF;
 		case WriteWord:
+		case AlignWord:
 			return WORD;
 		default:
 			return 0;
@@ -130,8 +321,9 @@ enum Type getSizeType(int state) {
 /* Parse a single line 'lineNumber' at p_line, using ParseMode 'mode'. Returns non-zero on error. */
 int parseLine(int lineNumber, char *p_line, enum ParseMode mode) {
 	char *p_tmp, *errorMsg;
-	int state = 0;
+	int state = 0, codeStart = imageCurrent(CODE_IMAGE), dataStart = imageCurrent(DATA_IMAGE);
 	enum StateAction action;
+	Symbol *dataLabel = NULL;
 	
 	while (state != StateAccept) {
 		/* Do predefined state action */
@@ -144,6 +336,8 @@ int parseLine(int lineNumber, char *p_line, enum ParseMode mode) {
 			printf("Warn on line %d: %s\n", lineNumber, getStateErrorMessage(state));
 		if ((action == AddCodeSymbol || action == AddDataSymbol) && addSymbols(mode, p_tmp, lineNumber, action))
 			return 1;
+		if (action == AddDataSymbol)
+			dataLabel = lookupSymbol(p_tmp);
 		if (action == InstructionParse && preInstruction(mode, p_tmp, &p_line, lineNumber))
 			return 1;
 		if (action == SetEntrySymbol && doSetEntrySymbol(mode, p_line, p_tmp, lineNumber))
@@ -156,12 +350,16 @@ int parseLine(int lineNumber, char *p_line, enum ParseMode mode) {
 		}
 		if ((action == WriteByte || action == WriteHalf || action == WriteWord) && writeData(mode, &p_line, lineNumber, getSizeType(state)))
 			return 1;
-		if (action == WriteChar || action == WriteTerminate) {
-			if (mode == PARSE_SYMBOLS)
-				imageExtend(DATA_IMAGE, BYTE);
-			else
-				imageWriteBytes(DATA_IMAGE, (action == WriteChar) ? p_line[-1] : '\0', BYTE);
-		}
+		if ((action == AlignHalf || action == AlignWord) && (parseOptions & NATURAL_ALIGN))
+			alignData(mode, getSizeType(state), dataLabel);
+		if (action == AlignToParameter && alignToParameter(mode, &p_line, lineNumber, dataLabel))
+			return 1;
+		if (action == AlignHalf || action == AlignWord || action == AlignToParameter)
+			dataStart = imageCurrent(DATA_IMAGE); /* The line starts after the padding, like its label */
+		if ((action == ReserveSpace || action == ReserveFill) && reserveData(mode, &p_line, lineNumber, action))
+			return 1;
+		if (action == WriteString && writeString(mode, &p_line, lineNumber, dataLabel))
+			return 1;
 
 		/* Change state or print error message */
 		errorMsg = getStateErrorMessage(state);
@@ -171,6 +369,13 @@ int parseLine(int lineNumber, char *p_line, enum ParseMode mode) {
 		}
 	}
 
+	if (mode == PARSE_ALL) { /* Record the address of lines that wrote to the image */
+		if (imageCurrent(CODE_IMAGE) != codeStart)
+			bufferLine(codeStart + CODE_START, lineNumber);
+		else if (imageCurrent(DATA_IMAGE) != dataStart)
+			bufferLine(dataStart + CODE_START + imageSize(CODE_IMAGE), lineNumber);
+	}
+
 	return 0;
 }
 
@@ -179,6 +384,8 @@ int parse(FILE *stream, enum ParseMode mode) {
 	char line[MAX_LINE + 1], c;
 	int error = 0, lineNumber = 1;
 	rewind(stream);
+	if (mode == PARSE_SYMBOLS)
+		alignPadding = 0;
 
 	while (line[MAX_LINE - 1] = '\0', fgets(line, MAX_LINE + 1, stream)) {
 		/* Check if last character (before '\0') was written to, and is not a newline. 
@@ -196,3 +403,8 @@ int parse(FILE *stream, enum ParseMode mode) {
 
 	return error;
 }
+
+/* Returns the number of padding bytes inserted for alignment in the first pass of the last parsed file */
+int getAlignPadding(void) {
+	return alignPadding;
+}
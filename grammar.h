@@ -5,8 +5,16 @@
 
 #define MAX_LINE 80
 #define MAX_LABEL 31
+#define MAX_ALIGN 4 /* Data starts at CODE_START plus the code size, both multiples of a word, so only offsets aligned up to a word are aligned addresses */
 
 enum ParseMode {PARSE_SYMBOLS, PARSE_ALL};
+enum ParseOption {MERGE_STRINGS = 1, NATURAL_ALIGN = 2};
+
+/* Sets the optional parsing behaviours, a combination of ParseOption flags */
+void setParseOptions(int options);
+
+/* Returns the number of padding bytes inserted for alignment in the first pass of the last parsed file */
+int getAlignPadding(void);
 
 int parse(FILE *stream, enum ParseMode m);
 
@@ -67,6 +67,21 @@ int IsAscii(char **p_line) {
 	(*p_line) += 5; /* Length of 'asciz' */
 	return 1;
 }
+int IsSpace(char **p_line) {
+	if (!startswith(*p_line, "space")) return 0;
+	(*p_line) += 5; /* Length of 'space' */
+	return 1;
+}
+int IsFill(char **p_line) {
+	if (!startswith(*p_line, "fill")) return 0;
+	(*p_line) += 4; /* Length of 'fill' */
+	return 1;
+}
+int IsAlign(char **p_line) {
+	if (!startswith(*p_line, "align")) return 0;
+	(*p_line) += 5; /* Length of 'align' */
+	return 1;
+}
 int IsAlpha(char **p_line) {
 	if (!isalpha(**p_line)) return 0;
 	(*p_line)++;
@@ -77,25 +92,15 @@ int IsAlnum(char **p_line) {
 	(*p_line)++;
 	return 1;
 }
-int IsPrint(char **p_line) {
-	if (!isprint(**p_line)) return 0;
-	(*p_line)++;
-	return 1;
-}
 int LabelMarker(char **p_line) {
 	if (**p_line != ':') return 0;
 	(*p_line)++;
 	return 1;
 }
-int Quotation(char **p_line) {
-	if (**p_line != '\"') return 0;
-	(*p_line)++;
-	return 1;
-}
 
 /* The state table that defines a state machine to parse the grammar */
 
-#define MAX_CONDITIONS 5
+#define MAX_CONDITIONS 7
 const static struct State {
 	enum StateAction stateAction; /* A predefined action that will be executed on changing to the state */
 	int (*conditions[MAX_CONDITIONS])(char **p_line); /* An array of conditions for changing states */
@@ -119,7 +124,7 @@ const static struct State {
 /* 14 - InstructionTail */				{ Nothing, {IsAlnum, Default}, {14, 15}, "" },
 /* 15 - InstructionEnd */				{ Nothing, {Spacing, End}, {16, 16}, "Invalid character in label or instruction" },
 /* 16 - Instruction */					{ InstructionParse, {End}, {StateAccept}, "Extraneous text after parameters" },
-/* 17 - Data */							{ Nothing, {IsBytes, IsHalves, IsWords, IsAscii}, {25, 26, 27, 28}, "Unrecognized directive" },
+/* 17 - Data */							{ Nothing, {IsBytes, IsHalves, IsWords, IsAscii, IsSpace, IsFill, IsAlign}, {25, 26, 27, 28, 36, 37, 40}, "Unrecognized directive" },
 /* 18 - EntryParameterStart */			{ SavePosition, {IsAlpha}, {19}, "Label must start with a letter" },
 /* 19 - EntryParameterTail */			{ Nothing, {IsAlnum, Default}, {19, 20}, "" },
 /* 20 - EntryParameterEnd */			{ SetEntrySymbol, {Default}, {24}, "" },
@@ -128,8 +133,8 @@ const static struct State {
 /* 23 - ExternParameterEnd */			{ SetExternSymbol, {Default}, {24}, "" },
 /* 24 - TrailingSpace */				{ Nothing, {Spacing, End}, {24, StateAccept}, "Extraneous text after parameter" },
 /* 25 - Bytes */						{ Nothing, {Spacing}, {29}, "Expected space after directive" },
-/* 26 - Halves */						{ Nothing, {Spacing}, {31}, "Expected space after directive" },
-/* 27 - Words */						{ Nothing, {Spacing}, {33}, "Expected space after directive" },
+/* 26 - Halves */						{ AlignHalf, {Spacing}, {31}, "Expected space after directive" },
+/* 27 - Words */						{ AlignWord, {Spacing}, {33}, "Expected space after directive" },
 /* 28 - Ascii */						{ Nothing, {Spacing}, {35}, "Expected space after directive" },
 /* 29 - Byte */							{ WriteByte, {Spacing, End, Default}, {30, StateAccept, 30}, "" },
 /* 30 - ByteSep */						{ ReadComma, {Spacing, Default}, {29, 29}, "" },
@@ -137,11 +142,13 @@ const static struct State {
 /* 32 - HalfSep */						{ ReadComma, {Spacing, Default}, {31, 31}, "" },
 /* 33 - Word */							{ WriteWord, {Spacing, End, Default}, {34, StateAccept, 34}, "" },
 /* 34 - WordSep */						{ ReadComma, {Spacing, Default}, {33, 33}, "" },
-/* 35 - StringStart */					{ Nothing, {Quotation}, {36}, "String must begin with quotation marks" },
-/* 36 - StringMid */					{ Nothing, {Quotation, IsPrint}, {37, 38}, "String can't contain non-printable characters and must be closed with quotation marks" },
-/* 37 - Quotation */					{ Nothing, {End, Default}, {39, 38}, "" },
-/* 38 - Char */							{ WriteChar, {Default}, {36}, "" },
-/* 39 - StringEnd */					{ WriteTerminate, {Default}, {StateAccept}, ""}
+/* 35 - String */						{ WriteString, {Default}, {24}, "" },
+/* 36 - Space */						{ Nothing, {Spacing}, {38}, "Expected space after directive" },
+/* 37 - Fill */							{ Nothing, {Spacing}, {39}, "Expected space after directive" },
+/* 38 - SpaceParameters */				{ ReserveSpace, {Default}, {24}, "" },
+/* 39 - FillParameters */				{ ReserveFill, {Default}, {24}, "" },
+/* 40 - Align */						{ Nothing, {Spacing}, {41}, "Expected space after directive" },
+/* 41 - AlignParameter */				{ AlignToParameter, {Default}, {24}, "" }
 };
 
 /* Returns the action the current state requires be run */
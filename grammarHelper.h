@@ -3,8 +3,9 @@
 
 #define NUMBER_BASE 10
 
-enum StateAction {Nothing, WriteTerminate, WriteChar, WriteWord, WriteHalf, ReadComma, WriteByte, SetExternSymbol, SetEntrySymbol, 
-                    InstructionParse, AddCodeSymbol, AddDataSymbol, PrintWarn, NullPrevious, SavePosition};
+enum StateAction {Nothing, WriteString, WriteWord, WriteHalf, ReadComma, WriteByte, SetExternSymbol, SetEntrySymbol, 
+                    InstructionParse, AddCodeSymbol, AddDataSymbol, PrintWarn, NullPrevious, SavePosition, ReserveSpace, ReserveFill,
+                    AlignHalf, AlignWord, AlignToParameter};
 
 enum {StateError = -2, StateAccept = -1};
 
@@ -0,0 +1,171 @@
+#include "memoryImage.h"
+#include "instructions.h"
+
+#define OPCODE_OFFSET 26
+#define FUNCT_OFFSET 6
+#define FUNCT_LENGTH 5
+#define FUNCT_OPCODES 2 /* Opcodes shared by several instructions, told apart by funct */
+
+#define MAX_PARAMS 4
+const static struct instruction {
+	char *name;
+	int opcode; /* Fits in 6 bits */
+	int paramNumber;
+	struct param {
+		int startbit; /* The starting bit for encoding (least significant) */
+		int length; /* Length of encoded param in bits */
+		int fixed; /* The value of the param is set to this if 'kind' is PARAM_FIXED */
+		enum ParamKind kind; /* How the param is read from input, and decoded */
+	} params[MAX_PARAMS];
+} instructions[] = {
+	/* R-type			rs							rt							rd							funct			*/
+	{"add",		0,	4,	{{21, 5, 0, PARAM_REGISTER},	{16, 5, 0, PARAM_REGISTER},	{11, 5, 0, PARAM_REGISTER},	{6, 5, 1, PARAM_FIXED}}},
+	{"sub",		0,	4,	{{21, 5, 0, PARAM_REGISTER},	{16, 5, 0, PARAM_REGISTER},	{11, 5, 0, PARAM_REGISTER},	{6, 5, 2, PARAM_FIXED}}},
+	{"and",		0,	4,	{{21, 5, 0, PARAM_REGISTER},	{16, 5, 0, PARAM_REGISTER},	{11, 5, 0, PARAM_REGISTER},	{6, 5, 3, PARAM_FIXED}}},
+	{"or",		0,	4,	{{21, 5, 0, PARAM_REGISTER},	{16, 5, 0, PARAM_REGISTER},	{11, 5, 0, PARAM_REGISTER},	{6, 5, 4, PARAM_FIXED}}},
+	{"nor",		0,	4,	{{21, 5, 0, PARAM_REGISTER},	{16, 5, 0, PARAM_REGISTER},	{11, 5, 0, PARAM_REGISTER},	{6, 5, 5, PARAM_FIXED}}},
+	/* Move     		rs							rd							funct			*/
+	{"move",	1,	3,	{{21, 5, 0, PARAM_REGISTER},	{11, 5,  0, PARAM_REGISTER},	{6, 5, 1, PARAM_FIXED}}},
+	{"mvhi",	1,	3,	{{21, 5, 0, PARAM_REGISTER},	{11, 5,  0, PARAM_REGISTER},	{6, 5, 2, PARAM_FIXED}}},
+	{"mvlo",	1,	3,	{{21, 5, 0, PARAM_REGISTER},	{11, 5,  0, PARAM_REGISTER},	{6, 5, 3, PARAM_FIXED}}},
+	/* I-type			rs							immed							rt			*/
+	{"addi",	10,	3,	{{21, 5, 0, PARAM_REGISTER},	{0, 16, 0, PARAM_CONSTANT},	{16, 5, 0, PARAM_REGISTER}}},
+	{"subi",	11,	3,	{{21, 5, 0, PARAM_REGISTER},	{0, 16, 0, PARAM_CONSTANT},	{16, 5, 0, PARAM_REGISTER}}},
+	{"andi",	12,	3,	{{21, 5, 0, PARAM_REGISTER},	{0, 16, 0, PARAM_CONSTANT},	{16, 5,  1, PARAM_REGISTER}}},
+	{"ori",		13,	3,	{{21, 5, 0, PARAM_REGISTER},	{0, 16, 0, PARAM_CONSTANT},	{16, 5, 0, PARAM_REGISTER}}},
+	{"nori",	14,	3,	{{21, 5, 0, PARAM_REGISTER},	{0, 16, 0, PARAM_CONSTANT},	{16, 5, 0, PARAM_REGISTER}}},
+	/* Branching		rs							rt							immed		 */
+	{"bne",		15, 3,	{{21, 5, 0, PARAM_REGISTER},	{16, 5, 0, PARAM_REGISTER},	{0, 16, 0, PARAM_INTERNAL_LABEL}}},
+	{"beq",		16, 3,	{{21, 5, 0, PARAM_REGISTER},	{16, 5, 0, PARAM_REGISTER},	{0, 16, 0, PARAM_INTERNAL_LABEL}}},
+	{"blt",		17, 3,	{{21, 5, 0, PARAM_REGISTER},	{16, 5, 0, PARAM_REGISTER},	{0, 16, 0, PARAM_INTERNAL_LABEL}}},
+	{"bgt",		18, 3,	{{21, 5, 0, PARAM_REGISTER},	{16, 5, 0, PARAM_REGISTER},	{0, 16, 0, PARAM_INTERNAL_LABEL}}},
+	/* Load/Save		rs							immed							rt			*/
+	{"lb",		19,	3,	{{21, 5, 0, PARAM_REGISTER},	{0, 16, 0, PARAM_CONSTANT},	{16, 5, 0, PARAM_REGISTER}}},
+	{"sb",		20,	3,	{{21, 5, 0, PARAM_REGISTER},	{0, 16, 0, PARAM_CONSTANT},	{16, 5, 0, PARAM_REGISTER}}},
+	{"lw",		21,	3,	{{21, 5, 0, PARAM_REGISTER},	{0, 16, 0, PARAM_CONSTANT},	{16, 5, 0, PARAM_REGISTER}}},
+	{"sw",		22,	3,	{{21, 5, 0, PARAM_REGISTER},	{0, 16, 0, PARAM_CONSTANT},	{16, 5, 0, PARAM_REGISTER}}},
+	{"lh",		23,	3,	{{21, 5, 0, PARAM_REGISTER},	{0, 16, 0, PARAM_CONSTANT},	{16, 5, 0, PARAM_REGISTER}}},
+	{"sh",		24,	3,	{{21, 5, 0, PARAM_REGISTER},	{0, 16, 0, PARAM_CONSTANT},	{16, 5, 0, PARAM_REGISTER}}},
+	/* J-type 			address				*/
+	{"jmp",		30,	2,	{{0, 26, 0, PARAM_LABEL_OR_REGISTER}}},
+	{"la",		31,	1,	{{0, 25, 0, PARAM_ANY_LABEL}}},
+	{"call",	32,	1,	{{0, 25, 0, PARAM_ANY_LABEL}}},
+	{"stop",	63,	0}
+};
+
+/* Builds an evaluated param into 'build' */
+void buildParam(long *build, int startbit, int length, long value) {
+	/* Add to build the value, constrained to length bits, shifted to startbit. */
+	*build |= (value & ((1L << length) - 1)) << startbit;
+}
+
+/* Decoding tables, derived from 'instructions'. Entries are instruction indices, or -1 if invalid. */
+static int opcodeTable[NUM_OPCODES];
+static int functTable[FUNCT_OPCODES][1 << FUNCT_LENGTH];
+
+/* Builds the opcode and funct decoding tables from the instruction descriptors. Must be called before decodeInstruction. */
+void prepareDecoding(void) {
+	int i, j;
+	for (i = 0; i < NUM_OPCODES; i++)
+		opcodeTable[i] = -1;
+	for (i = 0; i < FUNCT_OPCODES; i++)
+		for (j = 0; j < 1 << FUNCT_LENGTH; j++)
+			functTable[i][j] = -1;
+	for (i = 0; i < sizeof instructions / sizeof (struct instruction); i++) {
+		opcodeTable[instructions[i].opcode] = i;
+		if (instructions[i].opcode < FUNCT_OPCODES) /* Funct is the last, fixed, param */
+			functTable[instructions[i].opcode][instructions[i].params[instructions[i].paramNumber - 1].fixed] = i;
+	}
+}
+
+/* Returns the index of the instruction encoded in 'word', or -1 if it is not a valid instruction */
+int decodeInstruction(unsigned long word) {
+	int opcode = (int) (word >> OPCODE_OFFSET) & (NUM_OPCODES - 1);
+	if (opcode < FUNCT_OPCODES)
+		return functTable[opcode][(word >> FUNCT_OFFSET) & ((1 << FUNCT_LENGTH) - 1)];
+	return opcodeTable[opcode];
+}
+
+/* Returns the name of the instruction at 'index' */
+char *instructionName(int index) {
+	return instructions[index].name;
+}
+
+/* Returns the number of instructions, the bound of every instruction index */
+int instructionNumber(void) {
+	return sizeof instructions / sizeof (struct instruction);
+}
+
+/* Returns the number of params of the instruction at 'index', including fixed params */
+int instructionParamNumber(int index) {
+	return instructions[index].paramNumber;
+}
+
+/* Returns how param 'paramIndex' of the instruction at 'index' is read from input */
+enum ParamKind instructionParamKind(int index, int paramIndex) {
+	return instructions[index].params[paramIndex].kind;
+}
+
+/* Returns the kind of param 'paramIndex' of instruction 'index' as encoded in 'word', and stores its value in 'value'.
+ * Constants and branch offsets are sign extended. A jmp to a register is returned as PARAM_REGISTER. */
+enum ParamKind decodeParam(int index, int paramIndex, unsigned long word, long *value) {
+	const struct param *p = &instructions[index].params[paramIndex];
+	enum ParamKind kind = p->kind;
+	long mask = (1L << p->length) - 1;
+
+	*value = (long) (word >> p->startbit) & mask;
+	if (kind == PARAM_CONSTANT || kind == PARAM_INTERNAL_LABEL) {
+		if (*value & (1L << (p->length - 1))) /* Sign extend */
+			*value -= mask + 1;
+	}
+	else if (kind == PARAM_LABEL_OR_REGISTER) {
+		if (*value & (1L << LEN_ADDRESS)) {
+			*value &= NUM_REGISTERS - 1;
+			return PARAM_REGISTER;
+		}
+		return PARAM_ANY_LABEL;
+	}
+	return kind;
+}
+
+/* Returns the index of the first param of 'kind' in 'word' and stores its value, or -1 if there is none */
+int findParam(int index, unsigned long word, enum ParamKind kind, long *value) {
+	int i;
+	for (i = 0; i < instructions[index].paramNumber; i++)
+		if (decodeParam(index, i, word, value) == kind)
+			return i;
+	return -1;
+}
+
+/* Returns the address that 'word', at 'address', branches to or refers to by label, or -1 if it has none.
+ * External labels are encoded as 0, and have none. */
+long instructionTarget(unsigned long word, long address) {
+	int index;
+	long value;
+	if ((index = decodeInstruction(word)) < 0)
+		return -1;
+	if (findParam(index, word, PARAM_INTERNAL_LABEL, &value) >= 0)
+		return address + value;
+	if (findParam(index, word, PARAM_ANY_LABEL, &value) >= 0 && value != 0)
+		return value;
+	return -1;
+}
+
+/* Returns 'word' with param 'paramIndex' of instruction 'index' replaced by 'value' */
+unsigned long encodeParam(int index, int paramIndex, unsigned long word, long value) {
+	const struct param *p = &instructions[index].params[paramIndex];
+	long build = 0;
+	buildParam(&build, p->startbit, p->length, value);
+	return (word & ~(((1UL << p->length) - 1) << p->startbit)) | (unsigned long) build;
+}
+
+/* Returns the word of instruction 'index' with its opcode and fixed params, and every other param 0 */
+unsigned long encodeInstruction(int index) {
+	int i;
+	long build = 0;
+	for (i = 0; i < instructions[index].paramNumber; i++)
+		if (instructions[index].params[i].kind == PARAM_FIXED)
+			buildParam(&build, instructions[index].params[i].startbit, instructions[index].params[i].length, instructions[index].params[i].fixed);
+	buildParam(&build, OPCODE_OFFSET, 8 * WORD - OPCODE_OFFSET, instructions[index].opcode);
+	return (unsigned long) build;
+}
@@ -6,13 +6,10 @@
 #include "grammarHelper.h"
 #include "memoryImage.h"
 #include "symbols.h"
+#include "instructions.h"
 
 void buffer(Symbol *copy);
 
-#define NUM_REGISTERS 32
-#define LEN_ADDRESS 25
-#define OPCODE_OFFSET 26
-
 int readRegister(int lineNumber, char **p_line, int *value) {
 	long value_tmp;
 	char *p_tmp;
@@ -102,59 +99,16 @@ int readLabelOrRegister(int lineNumber, char **p_line, int *value) {
 	return 0;
 }
 
-
-#define MAX_PARAMS 4
-const static struct instruction {
-	char *name;
-	int opcode; /* Fits in 6 bits */
-	int paramNumber;
-	struct param {
-		int startbit; /* The starting bit for encoding (least significant) */
-		int length; /* Length of encoded param in bits */
-		int fixed; /* The value of the param is set to this if 'eval' is NULL */
-		int (*eval) (int lineNumber, char **p_line, int *value); /* Evaluate the value of this param given pointer to poisition in input. Return non-zero on error */
-	} params[MAX_PARAMS];
-} instructions[] = {
-	/* R-type			rs							rt							rd							funct			*/
-	{"add",		0,	4,	{{21, 5, 0, readRegister},	{16, 5, 0, readRegister},	{11, 5, 0, readRegister},	{6, 5, 1, NULL}}},
-	{"sub",		0,	4,	{{21, 5, 0, readRegister},	{16, 5, 0, readRegister},	{11, 5, 0, readRegister},	{6, 5, 2, NULL}}},
-	{"and",		0,	4,	{{21, 5, 0, readRegister},	{16, 5, 0, readRegister},	{11, 5, 0, readRegister},	{6, 5, 3, NULL}}},
-	{"or",		0,	4,	{{21, 5, 0, readRegister},	{16, 5, 0, readRegister},	{11, 5, 0, readRegister},	{6, 5, 4, NULL}}},
-	{"nor",		0,	4,	{{21, 5, 0, readRegister},	{16, 5, 0, readRegister},	{11, 5, 0, readRegister},	{6, 5, 5, NULL}}},
-	/* Move     		rs							rd							funct			*/
-	{"move",	1,	3,	{{21, 5, 0, readRegister},	{11, 5,  0, readRegister},	{6, 5, 1, NULL}}},
-	{"mvhi",	1,	3,	{{21, 5, 0, readRegister},	{11, 5,  0, readRegister},	{6, 5, 2, NULL}}},
-	{"mvlo",	1,	3,	{{21, 5, 0, readRegister},	{11, 5,  0, readRegister},	{6, 5, 3, NULL}}},
-	/* I-type			rs							immed							rt			*/
-	{"addi",	10,	3,	{{21, 5, 0, readRegister},	{0, 16, 0, readNumericConst},	{16, 5, 0, readRegister}}},
-	{"subi",	11,	3,	{{21, 5, 0, readRegister},	{0, 16, 0, readNumericConst},	{16, 5, 0, readRegister}}},
-	{"andi",	12,	3,	{{21, 5, 0, readRegister},	{0, 16, 0, readNumericConst},	{16, 5,  1, readRegister}}},
-	{"ori",		13,	3,	{{21, 5, 0, readRegister},	{0, 16, 0, readNumericConst},	{16, 5, 0, readRegister}}},
-	{"nori",	14,	3,	{{21, 5, 0, readRegister},	{0, 16, 0, readNumericConst},	{16, 5, 0, readRegister}}},
-	/* Branching		rs							rt							immed		 */
-	{"bne",		15, 3,	{{21, 5, 0, readRegister},	{16, 5, 0, readRegister},	{0, 16, 0, readInternalLabel}}},
-	{"beq",		16, 3,	{{21, 5, 0, readRegister},	{16, 5, 0, readRegister},	{0, 16, 0, readInternalLabel}}},
-	{"blt",		17, 3,	{{21, 5, 0, readRegister},	{16, 5, 0, readRegister},	{0, 16, 0, readInternalLabel}}},
-	{"bgt",		18, 3,	{{21, 5, 0, readRegister},	{16, 5, 0, readRegister},	{0, 16, 0, readInternalLabel}}},
-	/* Load/Save		rs							immed							rt			*/
-	{"lb",		19,	3,	{{21, 5, 0, readRegister},	{0, 16, 0, readNumericConst},	{16, 5, 0, readRegister}}},
-	{"sb",		20,	3,	{{21, 5, 0, readRegister},	{0, 16, 0, readNumericConst},	{16, 5, 0, readRegister}}},
-	{"lw",		21,	3,	{{21, 5, 0, readRegister},	{0, 16, 0, readNumericConst},	{16, 5, 0, readRegister}}},
-	{"sw",		22,	3,	{{21, 5, 0, readRegister},	{0, 16, 0, readNumericConst},	{16, 5, 0, readRegister}}},
-	{"lh",		23,	3,	{{21, 5, 0, readRegister},	{0, 16, 0, readNumericConst},	{16, 5, 0, readRegister}}},
-	{"sh",		24,	3,	{{21, 5, 0, readRegister},	{0, 16, 0, readNumericConst},	{16, 5, 0, readRegister}}},
-	/* J-type 			address				*/
-	{"jmp",		30,	2,	{{0, 26, 0, readLabelOrRegister}}},
-	{"la",		31,	1,	{{0, 25, 0, readAnyLabel}}},
-	{"call",	32,	1,	{{0, 25, 0, readAnyLabel}}},
-	{"stop",	63,	0}
+/* Param readers, indexed by ParamKind. Fixed params are not read. */
+static int (*const readers[]) (int lineNumber, char **p_line, int *value) = {
+	NULL, readRegister, readNumericConst, readInternalLabel, readAnyLabel, readLabelOrRegister
 };
 
 /* Adds keywords to symbol table, so that they can't be redfined */
 void prepareInstructions(void) {
 	int i;
-	for (i = 0; i < sizeof instructions / sizeof (struct instruction); i++) {
-		if (!installSymbol(instructions[i].name, i, INSTRUCTION_KEYWORD)) {
+	for (i = 0; i < instructionNumber(); i++) {
+		if (!installSymbol(instructionName(i), i, INSTRUCTION_KEYWORD)) {
 			printf("Error: Could not allocate required memory\n");
 			exit(1);
 		}
@@ -162,25 +116,22 @@ void prepareInstructions(void) {
 	/* Directives */
 	if (!(installSymbol("db", 0, DIRECTIVE_KEYWORD) && installSymbol("dh", 0, DIRECTIVE_KEYWORD) &&
 			installSymbol("dw", 0, DIRECTIVE_KEYWORD) && installSymbol("asciz", 0, DIRECTIVE_KEYWORD) &&
+			installSymbol("space", 0, DIRECTIVE_KEYWORD) && installSymbol("fill", 0, DIRECTIVE_KEYWORD) &&
+			installSymbol("align", 0, DIRECTIVE_KEYWORD) &&
 			installSymbol("entry", 0, DIRECTIVE_KEYWORD) && installSymbol("extern", 0, DIRECTIVE_KEYWORD))) {
 		printf("Error: Could not allocate required memory\n");
 		exit(1);
 	}
 }
 
-/* Builds an evaluated param into 'build' */
-void buildParam(long *build, int startbit, int length, long value) {
-	/* Add to build the value, constrained to length bits, shifted to startbit. */
-	*build |= (value & ((1L << length) - 1)) << startbit;
-}
-
 /* Parse a single instruction with instructionIndex, params begin at *p_line */
 int parseInstruction(int instructionIndex, char **p_line, int lineNumber) {
 	int paramIndex, value;
-	long build = 0;
+	enum ParamKind kind;
+	unsigned long build = encodeInstruction(instructionIndex); /* Opcode and fixed params */
 
-	for (paramIndex = 0; paramIndex < instructions[instructionIndex].paramNumber; paramIndex++) {
-		if (instructions[instructionIndex].params[paramIndex].eval != NULL) { /* Not a fixed value */
+	for (paramIndex = 0; paramIndex < instructionParamNumber(instructionIndex); paramIndex++) {
+		if ((kind = instructionParamKind(instructionIndex, paramIndex)) != PARAM_FIXED) {
 			/* comma state */
 			if (paramIndex != 0) {
 				if (*(*p_line)++ != ',') {
@@ -190,18 +141,13 @@ int parseInstruction(int instructionIndex, char **p_line, int lineNumber) {
 				Spacing(p_line);
 			}
 			/* param state */
-			if (instructions[instructionIndex].params[paramIndex].eval(lineNumber, p_line, &value))
+			if (readers[kind](lineNumber, p_line, &value))
 				return 1;
-			buildParam(&build, instructions[instructionIndex].params[paramIndex].startbit, 
-						instructions[instructionIndex].params[paramIndex].length, value);
+			build = encodeParam(instructionIndex, paramIndex, build, value);
 			Spacing(p_line);
 		}
-		else
-			buildParam(&build, instructions[instructionIndex].params[paramIndex].startbit, 
-						instructions[instructionIndex].params[paramIndex].length, instructions[instructionIndex].params[paramIndex].fixed);
 	}
-	buildParam(&build, OPCODE_OFFSET, (int) sizeof (char) * WORD - OPCODE_OFFSET, instructions[instructionIndex].opcode); /* Add opcode */
-	imageWriteBytes(CODE_IMAGE, build, WORD);
+	imageWriteBytes(CODE_IMAGE, (long) build, WORD);
 
 	return 0;
 }
@@ -0,0 +1,48 @@
+#ifndef INSTRUCTIONS
+#define INSTRUCTIONS
+
+#define NUM_OPCODES 64
+#define NUM_REGISTERS 32
+#define LEN_ADDRESS 25 /* jmp sets this bit when its param is a register */
+
+/* The instruction set and its decoders are in instructionSet.c, which needs nothing else. The param readers are in instructions.c. */
+
+/* How a param of an instruction is encoded */
+enum ParamKind {PARAM_FIXED, PARAM_REGISTER, PARAM_CONSTANT, PARAM_INTERNAL_LABEL, PARAM_ANY_LABEL, PARAM_LABEL_OR_REGISTER};
+
+/* Builds the opcode and funct decoding tables from the instruction descriptors. Must be called before decodeInstruction. */
+void prepareDecoding(void);
+
+/* Returns the index of the instruction encoded in 'word', or -1 if it is not a valid instruction */
+int decodeInstruction(unsigned long word);
+
+/* Returns the name of the instruction at 'index' */
+char *instructionName(int index);
+
+/* Returns the number of instructions, the bound of every instruction index */
+int instructionNumber(void);
+
+/* Returns the number of params of the instruction at 'index', including fixed params */
+int instructionParamNumber(int index);
+
+/* Returns how param 'paramIndex' of the instruction at 'index' is read from input */
+enum ParamKind instructionParamKind(int index, int paramIndex);
+
+/* Returns the kind of param 'paramIndex' of instruction 'index' as encoded in 'word', and stores its value in 'value'.
+ * Constants and branch offsets are sign extended. A jmp to a register is returned as PARAM_REGISTER. */
+enum ParamKind decodeParam(int index, int paramIndex, unsigned long word, long *value);
+
+/* Returns the index of the first param of 'kind' in 'word' and stores its value, or -1 if there is none */
+int findParam(int index, unsigned long word, enum ParamKind kind, long *value);
+
+/* Returns the address that 'word', at 'address', branches to or refers to by label, or -1 if it has none.
+ * External labels are encoded as 0, and have none. */
+long instructionTarget(unsigned long word, long address);
+
+/* Returns 'word' with param 'paramIndex' of instruction 'index' replaced by 'value' */
+unsigned long encodeParam(int index, int paramIndex, unsigned long word, long value);
+
+/* Returns the word of instruction 'index' with its opcode and fixed params, and every other param 0 */
+unsigned long encodeInstruction(int index);
+
+#endif
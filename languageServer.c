@@ -0,0 +1,1189 @@
+#define _POSIX_C_SOURCE 200809L /* dup, dup2, pread, ftruncate */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <limits.h>
+#include <unistd.h>
+
+#include "symbols.h"
+#include "memoryImage.h"
+#include "grammar.h"
+
+#define NAME_BUCKETS 4093 /* Buckets of the definitions and references of a document */
+#define MAX_HEADER 256
+#define SOURCE_NAME "assembler"
+
+int parseLine(int lineNumber, char *p_line, enum ParseMode mode);
+int imageAllocate(void);
+void imageDelete(void);
+void flushBuffers(int error, char *filename);
+
+/* Lists of lines a document keeps, besides the lines themselves */
+enum LineList {DIAGNOSTIC_LINES, ALIGN_LINES, LINE_LISTS};
+
+typedef struct LineLink {
+	struct DocLine *prev, *next;
+} LineLink;
+
+/* A line of an open document, with the results of parsing it on its own */
+typedef struct DocLine {
+	char *text; /* Without newline */
+	int codeSize, dataSize; /* Bytes added to the images in the first pass */
+	int padding; /* Alignment padding at the start of its data. The line and its label are after it. */
+	char *defined; /* Label or extern defined on this line, or NULL */
+	char *warning, *error; /* Diagnostic messages, or NULL */
+	int passed; /* Set if the first pass had no error */
+	int pending; /* Set while waiting for the second pass */
+	int aligns; /* Set if it may be an .align line, whose padding depends on its offset */
+	unsigned long generation; /* The last reparse that ran its first pass */
+	struct Mention *mentions; /* Names on the line */
+	struct DocLine *nextPending;
+	LineLink links[LINE_LISTS];
+	/* Node in the document's tree of lines, a treap ordered by position */
+	struct DocLine *left, *right, *parent;
+	int priority;
+	int lines; /* Number of lines in the subtree */
+	long codeSum, dataSum; /* Sizes of the lines in the subtree */
+} DocLine;
+
+/* A label or extern defined in a document */
+typedef struct Definition {
+	char *name;
+	DocLine *line; /* A line defining it */
+	enum Attribute attribute;
+	int count; /* Number of lines defining it, more than one only for externs */
+	struct Definition *next;
+} Definition;
+
+/* A line on which a name appears */
+typedef struct Mention {
+	DocLine *line;
+	struct Reference *reference;
+	struct Mention *prev, *next; /* Other lines the name appears on */
+	struct Mention *nextInLine; /* Other names on the line */
+} Mention;
+
+/* The lines a name appears on */
+typedef struct Reference {
+	char *name;
+	Mention *mentions;
+	struct Reference *next;
+} Reference;
+
+typedef struct Document {
+	char *uri;
+	DocLine *root; /* Tree of the lines, for the line at an index, and the index and offset of a line */
+	DocLine *lists[LINE_LISTS]; /* Lines with diagnostics, and .align lines */
+	DocLine *pending; /* Lines waiting for the second pass */
+	int firstResized; /* Index of the first line whose data size changed since the last reparse, or INT_MAX */
+	unsigned long generation; /* Number of reparses */
+	Definition *definitions[NAME_BUCKETS];
+	Reference *references[NAME_BUCKETS];
+	struct Document *next;
+} Document;
+
+/* A growing text, for building messages */
+typedef struct Text {
+	char *s;
+	long length, capacity;
+} Text;
+
+/* Names whose definitions changed during an edit */
+typedef struct NameList {
+	char **names;
+	int count, capacity;
+} NameList;
+
+static Document *documents, *active; /* Open documents, and the one whose symbols are in the symbol table */
+static FILE *client; /* Protocol output. stdout is redirected, to capture the parser's messages. */
+
+/* Exits on memory failure, like the rest of the assembler */
+void *allocate(void *p, long size) {
+	if (!(p = realloc(p, size))) {
+		fprintf(stderr, "Error: Could not allocate required memory\n");
+		exit(1);
+	}
+	return p;
+}
+
+char *copyString(const char *s, long length) {
+	char *p = (char *) allocate(NULL, length + 1);
+	memcpy(p, s, length);
+	p[length] = '\0';
+	return p;
+}
+
+/* Text building */
+
+void textAppend(Text *t, const char *s, long length) {
+	if (t->length + length + 1 > t->capacity) {
+		t->capacity = t->capacity * 2 + length + 64;
+		t->s = (char *) allocate(t->s, t->capacity);
+	}
+	memcpy(t->s + t->length, s, length);
+	t->s[t->length += length] = '\0';
+}
+
+void textString(Text *t, const char *s) {
+	textAppend(t, s, strlen(s));
+}
+
+/* Appends formatted text, growing 't' to fit it */
+void textPrintf(Text *t, const char *format, ...) {
+	int length;
+	va_list ap;
+	va_start(ap, format);
+	length = vsnprintf(NULL, 0, format, ap);
+	va_end(ap);
+	if (length < 0)
+		return;
+	if (t->length + length + 1 > t->capacity) {
+		t->capacity = t->capacity * 2 + length + 64;
+		t->s = (char *) allocate(t->s, t->capacity);
+	}
+	va_start(ap, format);
+	vsnprintf(t->s + t->length, length + 1, format, ap);
+	va_end(ap);
+	t->length += length;
+}
+
+/* Appends 's' as a quoted JSON string */
+void textJsonString(Text *t, const char *s) {
+	textString(t, "\"");
+	for (; *s; s++) {
+		if (*s == '"' || *s == '\\')
+			textPrintf(t, "\\%c", *s);
+		else if ((unsigned char) *s < ' ')
+			textPrintf(t, "\\u%04x", *s);
+		else
+			textAppend(t, s, 1);
+	}
+	textString(t, "\"");
+}
+
+/* JSON reading. Values are read in place, from a pointer to their first character. */
+
+const char *jsonSpace(const char *p) {
+	while (*p && isspace((unsigned char) *p)) p++;
+	return p;
+}
+
+/* Returns a pointer after the value at 'p' */
+const char *jsonSkip(const char *p) {
+	int depth = 0;
+	p = jsonSpace(p);
+	do {
+		if (*p == '"') {
+			for (p++; *p && *p != '"'; p++)
+				if (*p == '\\' && p[1])
+					p++;
+			if (*p)
+				p++;
+		}
+		else if (*p == '{' || *p == '[')
+			depth++, p++;
+		else if (*p == '}' || *p == ']')
+			depth--, p++;
+		else if (depth > 0)
+			p++;
+		else
+			while (*p && !strchr(",}] \t\r\n", *p)) p++;
+	} while (depth > 0 && *p);
+	return p;
+}
+
+/* Returns the value of member 'key' of the object at 'p', or NULL */
+const char *jsonMember(const char *p, const char *key) {
+	int length = strlen(key);
+	if (!p || *(p = jsonSpace(p)) != '{')
+		return NULL;
+	for (p = jsonSpace(p + 1); *p == '"'; p = jsonSpace(p + 1)) {
+		int match = !strncmp(p + 1, key, length) && p[length + 1] == '"';
+		p = jsonSpace(jsonSpace(jsonSkip(p)) + 1); /* Skip key and ':' */
+		if (match)
+			return p;
+		if (*(p = jsonSpace(jsonSkip(p))) != ',')
+			return NULL;
+	}
+	return NULL;
+}
+
+/* Follows a NULL terminated path of member keys from the object at 'p'. Returns the value, or NULL. */
+const char *jsonGet(const char *p, ...) {
+	const char *key;
+	va_list ap;
+	va_start(ap, p);
+	while (p && (key = va_arg(ap, const char *)))
+		p = jsonMember(p, key);
+	va_end(ap);
+	return p;
+}
+
+/* Returns element 'index' of the array at 'p', or NULL */
+const char *jsonElement(const char *p, int index) {
+	if (!p || *(p = jsonSpace(p)) != '[')
+		return NULL;
+	for (p = jsonSpace(p + 1); *p && *p != ']'; index--) {
+		if (index == 0)
+			return p;
+		if (*(p = jsonSpace(jsonSkip(p))) != ',')
+			return NULL;
+		p = jsonSpace(p + 1);
+	}
+	return NULL;
+}
+
+long jsonNumber(const char *p) {
+	return p ? strtol(p, NULL, 10) : 0;
+}
+
+/* Returns a copy of the JSON string at 'p' without escapes, or NULL if it is not a string */
+char *jsonString(const char *p) {
+	Text t = {NULL, 0, 0};
+	char c, hex[5];
+	unsigned long code;
+	if (!p || *(p = jsonSpace(p)) != '"')
+		return NULL;
+	textString(&t, "");
+	for (p++; *p && *p != '"'; p++) {
+		if (*p != '\\') {
+			textAppend(&t, p, 1);
+			continue;
+		}
+		switch (*++p) {
+			case 'n': c = '\n'; break;
+			case 't': c = '\t'; break;
+			case 'r': c = '\r'; break;
+			case 'b': c = '\b'; break;
+			case 'f': c = '\f'; break;
+			case 'u':
+				strncpy(hex, p + 1, 4);
+				hex[4] = '\0';
+				code = strtoul(hex, NULL, 16);
+				p += strlen(hex);
+				if (code < 0x80)
+					c = (char) code;
+				else if (code < 0x800) {
+					textPrintf(&t, "%c", (char) (0xC0 | code >> 6));
+					c = (char) (0x80 | (code & 0x3F));
+				}
+				else {
+					textPrintf(&t, "%c%c", (char) (0xE0 | code >> 12), (char) (0x80 | ((code >> 6) & 0x3F)));
+					c = (char) (0x80 | (code & 0x3F));
+				}
+				break;
+			default: c = *p;
+		}
+		textAppend(&t, &c, 1);
+	}
+	return t.s;
+}
+
+/* Capturing the parser's messages */
+
+/* Moves stdout to a temporary file, keeping the original for the protocol. Returns non-zero on failure. */
+int startCapture(void) {
+	FILE *capture;
+	int fd;
+	fflush(stdout);
+	if ((fd = dup(STDOUT_FILENO)) < 0 || !(client = fdopen(fd, "w")) || !(capture = tmpfile()) ||
+			dup2(fileno(capture), STDOUT_FILENO) < 0)
+		return 1;
+	return 0;
+}
+
+/* Returns what the parser printed since the last call, and clears it */
+char *takeCaptured(void) {
+	char *captured;
+	long end;
+	if ((end = ftell(stdout)) == 0) /* Nothing printed, the common case */
+		return copyString("", 0);
+	fflush(stdout);
+	captured = (char *) allocate(NULL, (end > 0 ? end : 0) + 1);
+	captured[end > 0 && pread(STDOUT_FILENO, captured, end, 0) == end ? end : 0] = '\0';
+	if (ftruncate(STDOUT_FILENO, 0) == 0)
+		lseek(STDOUT_FILENO, 0, SEEK_SET);
+	return captured;
+}
+
+/* Returns a copy of the message of the first captured line starting with 'kind' ("Error" or "Warn"), or NULL */
+char *findMessage(const char *captured, const char *kind) {
+	const char *message, *end;
+	for (; *captured; captured = *end ? end + 1 : end) {
+		end = strchr(captured, '\n');
+		end = end ? end : captured + strlen(captured);
+		if (!strncmp(captured, kind, strlen(kind)) && (message = strstr(captured, ": ")) && message < end)
+			return copyString(message + 2, end - message - 2);
+	}
+	return NULL;
+}
+
+/* Tree of lines */
+
+int subtreeLines(DocLine *t) {
+	return t ? t->lines : 0;
+}
+
+/* Recounts a node from its own sizes and its children */
+void treeUpdate(DocLine *t) {
+	DocLine *children[2];
+	int i;
+	t->lines = 1;
+	t->codeSum = t->codeSize;
+	t->dataSum = t->dataSize;
+	children[0] = t->left;
+	children[1] = t->right;
+	for (i = 0; i < 2; i++) {
+		if (children[i]) {
+			t->lines += children[i]->lines;
+			t->codeSum += children[i]->codeSum;
+			t->dataSum += children[i]->dataSum;
+			children[i]->parent = t;
+		}
+	}
+}
+
+/* Joins two trees, where the lines of 'a' come before those of 'b' */
+DocLine *treeMerge(DocLine *a, DocLine *b) {
+	if (!a || !b)
+		return a ? a : b;
+	if (a->priority > b->priority) {
+		a->right = treeMerge(a->right, b);
+		treeUpdate(a);
+		return a;
+	}
+	b->left = treeMerge(a, b->left);
+	treeUpdate(b);
+	return b;
+}
+
+/* Splits 't' to its first 'count' lines and the rest */
+void treeSplit(DocLine *t, int count, DocLine **first, DocLine **rest) {
+	if (!t) {
+		*first = *rest = NULL;
+		return;
+	}
+	if (subtreeLines(t->left) < count) {
+		treeSplit(t->right, count - subtreeLines(t->left) - 1, &t->right, rest);
+		*first = t;
+	}
+	else {
+		treeSplit(t->left, count, first, &t->left);
+		*rest = t;
+	}
+	treeUpdate(t);
+}
+
+int lineCount(Document *d) {
+	return subtreeLines(d->root);
+}
+
+/* Returns the line at 'index', or NULL */
+DocLine *lineAt(Document *d, int index) {
+	DocLine *t = d->root;
+	while (t && subtreeLines(t->left) != index) {
+		if (index < subtreeLines(t->left))
+			t = t->left;
+		else {
+			index -= subtreeLines(t->left) + 1;
+			t = t->right;
+		}
+	}
+	return t;
+}
+
+/* Returns the index of line 'l', and stores the total sizes of the lines before it in 'code' and 'data', unless they are NULL */
+int lineIndex(DocLine *l, long *code, long *data) {
+	int index = subtreeLines(l->left);
+	long codeBefore = l->left ? l->left->codeSum : 0, dataBefore = l->left ? l->left->dataSum : 0;
+	for (; l->parent; l = l->parent) {
+		if (l->parent->right == l) { /* The parent and its left subtree come before */
+			index += subtreeLines(l->parent->left) + 1;
+			codeBefore += l->parent->codeSum - l->codeSum;
+			dataBefore += l->parent->dataSum - l->dataSum;
+		}
+	}
+	if (code)
+		*code = codeBefore;
+	if (data)
+		*data = dataBefore;
+	return index;
+}
+
+/* Sets the sizes of line 'l', updating the sums above it in place */
+void lineResize(DocLine *l, int codeSize, int dataSize) {
+	long codeDelta = codeSize - l->codeSize, dataDelta = dataSize - l->dataSize;
+	l->codeSize = codeSize;
+	l->dataSize = dataSize;
+	for (; l; l = l->parent) {
+		l->codeSum += codeDelta;
+		l->dataSum += dataDelta;
+	}
+}
+
+/* Adds 'l' to a list of its document, unless it is in it */
+void listAdd(Document *d, DocLine *l, enum LineList list) {
+	if (l->links[list].prev || d->lists[list] == l)
+		return;
+	if ((l->links[list].next = d->lists[list]))
+		d->lists[list]->links[list].prev = l;
+	d->lists[list] = l;
+}
+
+/* Removes 'l' from a list of its document, if it is in it */
+void listRemove(Document *d, DocLine *l, enum LineList list) {
+	if (l->links[list].prev)
+		l->links[list].prev->links[list].next = l->links[list].next;
+	else if (d->lists[list] == l)
+		d->lists[list] = l->links[list].next;
+	else
+		return;
+	if (l->links[list].next)
+		l->links[list].next->links[list].prev = l->links[list].prev;
+	l->links[list].prev = l->links[list].next = NULL;
+}
+
+/* Keeps 'l' in the list of lines with diagnostics, only while it has any */
+void updateDiagnostics(Document *d, DocLine *l) {
+	if (l->error || l->warning)
+		listAdd(d, l, DIAGNOSTIC_LINES);
+	else
+		listRemove(d, l, DIAGNOSTIC_LINES);
+}
+
+/* Names */
+
+unsigned nameHash(const char *name) {
+	unsigned hashval;
+	for (hashval = 0; *name; name++)
+		hashval = (unsigned char) *name + 31 * hashval;
+	return hashval % NAME_BUCKETS;
+}
+
+Definition *lookupDefinition(Document *d, char *name) {
+	Definition *def;
+	for (def = d->definitions[nameHash(name)]; def; def = def->next)
+		if (!strcmp(def->name, name))
+			return def;
+	return NULL;
+}
+
+Reference *lookupReference(Document *d, const char *name) {
+	Reference *r;
+	for (r = d->references[nameHash(name)]; r; r = r->next)
+		if (!strcmp(r->name, name))
+			return r;
+	return NULL;
+}
+
+void addName(NameList *changed, char *name) {
+	if (changed->count == changed->capacity) {
+		changed->capacity = changed->capacity * 2 + 8;
+		changed->names = (char **) allocate(changed->names, changed->capacity * sizeof (char *));
+	}
+	changed->names[changed->count++] = copyString(name, strlen(name));
+}
+
+/* Records the names on line 'l', other than keywords, so that the lines a name appears on can be found */
+void indexLine(Document *d, DocLine *l) {
+	const char *p = l->text, *start;
+	char *word;
+	Symbol *s;
+	Reference *r;
+	Mention *m;
+	unsigned hashval;
+
+	while (*p) {
+		if (!isalnum((unsigned char) *p)) {
+			p++;
+			continue;
+		}
+		for (start = p; isalnum((unsigned char) *p); p++);
+		if (!isalpha((unsigned char) *start))
+			continue;
+		word = copyString(start, p - start);
+		if ((s = lookupSymbol(word)) && (hasAttribute(s, INSTRUCTION_KEYWORD) || hasAttribute(s, DIRECTIVE_KEYWORD))) {
+			free(word);
+			continue;
+		}
+		if (!(r = lookupReference(d, word))) {
+			r = (Reference *) allocate(NULL, sizeof (Reference));
+			r->name = word;
+			r->mentions = NULL;
+			hashval = nameHash(word);
+			r->next = d->references[hashval];
+			d->references[hashval] = r;
+		}
+		else
+			free(word);
+		if (r->mentions && r->mentions->line == l) /* Appeared earlier on the line */
+			continue;
+		m = (Mention *) allocate(NULL, sizeof (Mention));
+		m->line = l;
+		m->reference = r;
+		m->prev = NULL;
+		if ((m->next = r->mentions))
+			r->mentions->prev = m;
+		r->mentions = m;
+		m->nextInLine = l->mentions;
+		l->mentions = m;
+	}
+}
+
+/* Removes the names on line 'l' from the index */
+void unindexLine(Document *d, DocLine *l) {
+	Mention *m;
+	Reference *r, **walk;
+	while ((m = l->mentions)) {
+		l->mentions = m->nextInLine;
+		r = m->reference;
+		if (m->prev)
+			m->prev->next = m->next;
+		else
+			r->mentions = m->next;
+		if (m->next)
+			m->next->prev = m->prev;
+		free(m);
+		if (!r->mentions) { /* On no line anymore */
+			for (walk = &d->references[nameHash(r->name)]; *walk != r; walk = &(*walk)->next);
+			*walk = r->next;
+			free(r->name);
+			free(r);
+		}
+	}
+}
+
+/* Records that line 'l' defines 'name' */
+void define(Document *d, DocLine *l, char *name, enum Attribute attribute) {
+	Definition *def;
+	unsigned hashval;
+	if ((def = lookupDefinition(d, name)))
+		def->count++;
+	else {
+		def = (Definition *) allocate(NULL, sizeof (Definition));
+		def->name = copyString(name, strlen(name));
+		def->line = l;
+		def->attribute = attribute;
+		def->count = 1;
+		hashval = nameHash(name);
+		def->next = d->definitions[hashval];
+		d->definitions[hashval] = def;
+	}
+	l->defined = copyString(name, strlen(name));
+}
+
+/* Removes the definition made by line 'l', if any */
+void undefine(Document *d, DocLine *l) {
+	Definition **walk, *def;
+	Reference *r;
+	Mention *m;
+	if (!l->defined)
+		return;
+	for (walk = &d->definitions[nameHash(l->defined)]; (def = *walk); walk = &def->next) {
+		if (strcmp(def->name, l->defined))
+			continue;
+		if (--def->count == 0) {
+			*walk = def->next;
+			deleteSymbol(def->name);
+			free(def->name);
+			free(def);
+		}
+		else if (def->line == l && (r = lookupReference(d, def->name))) /* Another line declares the same extern */
+			for (m = r->mentions; m; m = m->next)
+				if (m->line != l && m->line->defined && !strcmp(m->line->defined, l->defined))
+					def->line = m->line;
+		break;
+	}
+	free(l->defined);
+	l->defined = NULL;
+}
+
+/* Puts the definitions of 'd' in the symbol table, if they are not already there */
+void activate(Document *d) {
+	int i;
+	Definition *def;
+	if (active == d)
+		return;
+	deleteTable(CODE | DATA | EXTERNAL | ENTRY);
+	for (i = 0; i < NAME_BUCKETS; i++)
+		for (def = d->definitions[i]; def; def = def->next)
+			if (!installSymbol(def->name, 0, def->attribute)) {
+				fprintf(stderr, "Error: Could not allocate required memory\n");
+				exit(1);
+			}
+	active = d;
+}
+
+/* Returns a copy of the label or extern a line would define, or NULL */
+char *definedName(const char *text) {
+	const char *start, *end;
+	for (start = text; isspace((unsigned char) *start); start++);
+	for (end = start; isalnum((unsigned char) *end); end++);
+	if (isalpha((unsigned char) *start) && *end == ':') { /* Label, unless on an entry or extern */
+		for (text = end + 1; isspace((unsigned char) *text); text++);
+		if (strncmp(text, ".extern", 7) && strncmp(text, ".entry", 6))
+			return copyString(start, end - start);
+	}
+	else
+		text = start;
+	if (strncmp(text, ".extern", 7))
+		return NULL;
+	for (start = text + 7; isspace((unsigned char) *start); start++);
+	for (end = start; isalnum((unsigned char) *end); end++);
+	return end > start ? copyString(start, end - start) : NULL;
+}
+
+/* Parsing lines */
+
+/* Runs the first pass on line 'l' alone, updating its sizes and definitions */
+void firstPass(Document *d, DocLine *l, NameList *changed) {
+	char line[MAX_LINE + 2], *name, *captured, *old = l->defined;
+	Symbol *s;
+	int existed, index, padding = 0, codeSize = 0, dataSize = 0, oldAttribute = 0;
+	long dataBefore;
+
+	if (old) {
+		oldAttribute = lookupDefinition(d, old)->attribute;
+		l->defined = copyString(old, strlen(old));
+	}
+	undefine(d, l);
+	free(l->warning);
+	free(l->error);
+	l->warning = l->error = NULL;
+	l->passed = 0;
+	l->generation = d->generation;
+	if (!l->pending) {
+		l->pending = 1;
+		l->nextPending = d->pending;
+		d->pending = l;
+	}
+	if (strlen(l->text) > MAX_LINE) {
+		sprintf(line, "Exceeds maximum length of %d characters", MAX_LINE);
+		l->error = copyString(line, strlen(line));
+	}
+	else {
+		sprintf(line, "%s\n", l->text);
+		existed = (name = definedName(l->text)) && lookupSymbol(name);
+		index = lineIndex(l, NULL, &dataBefore);
+		imageDelete();
+		imageReserve(DATA_IMAGE, BYTE, (int) dataBefore); /* For alignment */
+		padding = getAlignPadding();
+		l->passed = !parseLine(index + 1, line, PARSE_SYMBOLS);
+		padding = getAlignPadding() - padding;
+		codeSize = imageSize(CODE_IMAGE);
+		dataSize = imageSize(DATA_IMAGE) - (int) dataBefore;
+		captured = takeCaptured();
+		l->error = findMessage(captured, "Error");
+		l->warning = findMessage(captured, "Warn");
+		free(captured);
+		if (name && (s = lookupSymbol(name)) && (!existed || (hasAttribute(s, EXTERNAL) && l->passed)))
+			define(d, l, name, s->attribute & (CODE | DATA | EXTERNAL));
+		free(name);
+		imageDelete();
+	}
+	if (!(old && l->defined && !strcmp(old, l->defined) && lookupDefinition(d, old)->attribute == oldAttribute)) {
+		if (old) /* Only names whose definition changed affect other lines */
+			addName(changed, old);
+		if (l->defined)
+			addName(changed, l->defined);
+	}
+	free(old);
+	if (dataSize != l->dataSize && (index = lineIndex(l, NULL, NULL)) < d->firstResized)
+		d->firstResized = index; /* Later .align lines may pad differently */
+	lineResize(l, codeSize, dataSize);
+	l->padding = padding;
+	updateDiagnostics(d, l);
+}
+
+/* Runs the second pass on line 'l' alone, into a scratch image, to validate its references */
+void secondPass(Document *d, DocLine *l) {
+	char line[MAX_LINE + 2], *captured;
+	l->pending = 0;
+	if (!l->passed)
+		return;
+	free(l->error);
+	l->error = NULL;
+	imageDelete();
+	imageReserve(CODE_IMAGE, BYTE, l->codeSize);
+	imageReserve(DATA_IMAGE, BYTE, l->dataSize);
+	if (imageAllocate())
+		l->error = copyString("Could not allocate required memory", 34);
+	else {
+		sprintf(line, "%s\n", l->text);
+		parseLine(lineIndex(l, NULL, NULL) + 1, line, PARSE_ALL);
+		flushBuffers(1, NULL); /* Drop buffered entries and externs */
+		captured = takeCaptured();
+		l->error = findMessage(captured, "Error");
+		free(captured);
+	}
+	imageDelete();
+	updateDiagnostics(d, l);
+}
+
+DocLine *newLine(const char *text, long length) {
+	DocLine *l = (DocLine *) allocate(NULL, sizeof (DocLine));
+	memset(l, 0, sizeof (DocLine));
+	if (length > 0 && text[length - 1] == '\r')
+		length--;
+	l->text = copyString(text, length);
+	l->aligns = strstr(l->text, ".align") != NULL;
+	l->priority = rand();
+	treeUpdate(l);
+	return l;
+}
+
+void deleteLine(DocLine *l) {
+	Mention *m;
+	while ((m = l->mentions)) {
+		l->mentions = m->nextInLine;
+		free(m);
+	}
+	free(l->text);
+	free(l->defined);
+	free(l->warning);
+	free(l->error);
+	free(l);
+}
+
+/* Deletes the lines of tree 't', with their definitions and names */
+void removeLines(Document *d, DocLine *t, NameList *changed) {
+	int i;
+	if (!t)
+		return;
+	removeLines(d, t->left, changed);
+	removeLines(d, t->right, changed);
+	if (t->defined)
+		addName(changed, t->defined);
+	undefine(d, t);
+	unindexLine(d, t);
+	for (i = 0; i < LINE_LISTS; i++)
+		listRemove(d, t, (enum LineList) i);
+	deleteLine(t);
+}
+
+/* Replaces 'removeCount' lines from 'first' with the lines of 'text'. Returns the number of new lines. */
+int spliceLines(Document *d, int first, int removeCount, const char *text, NameList *changed) {
+	const char *end;
+	DocLine *before, *removed, *after, *added = NULL, *l;
+	int addCount = 0;
+
+	treeSplit(d->root, first, &before, &after);
+	treeSplit(after, removeCount, &removed, &after);
+	if (removed && removed->dataSum && first - 1 < d->firstResized)
+		d->firstResized = first - 1; /* The following lines move */
+	removeLines(d, removed, changed);
+
+	do { /* Split to lines */
+		end = strchr(text, '\n');
+		l = newLine(text, end ? end - text : (long) strlen(text));
+		indexLine(d, l);
+		if (l->aligns)
+			listAdd(d, l, ALIGN_LINES);
+		added = treeMerge(added, l);
+		addCount++;
+		text = end + 1;
+	} while (end);
+
+	if ((d->root = treeMerge(treeMerge(before, added), after)))
+		d->root->parent = NULL;
+	return addCount;
+}
+
+/* A line and its index, for sorting */
+typedef struct LinePosition {
+	DocLine *line;
+	int index;
+} LinePosition;
+
+int comparePositions(const void *a, const void *b) {
+	return ((const LinePosition *) a)->index - ((const LinePosition *) b)->index;
+}
+
+/* Sizes the .align lines after the first resized line again, in order, since their padding depends on their offset */
+void resizeAligned(Document *d, NameList *changed) {
+	LinePosition *aligned;
+	DocLine *l;
+	int i, count = 0;
+
+	for (l = d->lists[ALIGN_LINES]; l; l = l->links[ALIGN_LINES].next)
+		count++;
+	aligned = (LinePosition *) allocate(NULL, (count ? count : 1) * sizeof (LinePosition));
+	for (count = 0, l = d->lists[ALIGN_LINES]; l; l = l->links[ALIGN_LINES].next)
+		if ((aligned[count].index = lineIndex(l, NULL, NULL)) > d->firstResized)
+			aligned[count++].line = l;
+	qsort(aligned, count, sizeof (LinePosition), comparePositions);
+	for (i = 0; i < count; i++)
+		firstPass(d, aligned[i].line, changed);
+	free(aligned);
+	d->firstResized = INT_MAX;
+}
+
+/* Reparses the lines changed by an edit, and the lines its changed definitions and sizes affect */
+void reparse(Document *d, int first, int newCount, NameList *changed) {
+	Reference *r;
+	Mention *m;
+	DocLine *l;
+	LinePosition *mentioned = NULL;
+	int i, names, count = 0, capacity = 0;
+
+	d->generation++;
+	for (i = first; i < first + newCount; i++)
+		firstPass(d, lineAt(d, i), changed);
+
+	names = changed->count; /* Lines mentioning a changed name may have changed definitions or references */
+	for (i = 0; i < names; i++) {
+		for (r = lookupReference(d, changed->names[i]), m = r ? r->mentions : NULL; m; m = m->next) {
+			if (m->line->generation == d->generation) /* Already parsed, or found through another name */
+				continue;
+			if (count == capacity) {
+				capacity = capacity * 2 + 8;
+				mentioned = (LinePosition *) allocate(mentioned, capacity * sizeof (LinePosition));
+			}
+			m->line->generation = d->generation;
+			mentioned[count].line = m->line;
+			mentioned[count++].index = lineIndex(m->line, NULL, NULL);
+		}
+	}
+	if (count) /* In line order, so the first of duplicate labels defines it */
+		qsort(mentioned, count, sizeof (LinePosition), comparePositions);
+	for (i = 0; i < count; i++)
+		firstPass(d, mentioned[i].line, changed);
+	free(mentioned);
+
+	if (d->firstResized != INT_MAX)
+		resizeAligned(d, changed);
+
+	while ((l = d->pending)) {
+		d->pending = l->nextPending;
+		secondPass(d, l);
+	}
+
+	for (i = 0; i < changed->count; i++)
+		free(changed->names[i]);
+	changed->count = 0;
+}
+
+/* Protocol */
+
+void sendMessage(Text *t) {
+	fprintf(client, "Content-Length: %ld\r\n\r\n", t->length);
+	fwrite(t->s, 1, t->length, client);
+	fflush(client);
+	free(t->s);
+}
+
+/* Responds to the request with 'id' (raw JSON) with 'result' (raw JSON) */
+void respond(const char *id, const char *result) {
+	Text t = {NULL, 0, 0};
+	textString(&t, "{\"jsonrpc\":\"2.0\",\"id\":");
+	textAppend(&t, id, jsonSkip(id) - id);
+	textString(&t, ",\"result\":");
+	textString(&t, result);
+	textString(&t, "}");
+	sendMessage(&t);
+}
+
+void appendDiagnostic(Text *t, int *first, DocLine *l, int index, int severity, char *message) {
+	textPrintf(t, "%s{\"range\":{\"start\":{\"line\":%d,\"character\":0},\"end\":{\"line\":%d,\"character\":%ld}},"
+			"\"severity\":%d,\"source\":\"" SOURCE_NAME "\",\"message\":", *first ? "" : ",", index, index, (long) strlen(l->text), severity);
+	textJsonString(t, message);
+	textString(t, "}");
+	*first = 0;
+}
+
+void publishDiagnostics(Document *d, int clear) {
+	Text t = {NULL, 0, 0};
+	LinePosition *lines;
+	DocLine *l;
+	int i, count = 0, first = 1;
+
+	for (l = d->lists[DIAGNOSTIC_LINES]; !clear && l; l = l->links[DIAGNOSTIC_LINES].next)
+		count++;
+	lines = (LinePosition *) allocate(NULL, (count ? count : 1) * sizeof (LinePosition));
+	for (i = 0, l = d->lists[DIAGNOSTIC_LINES]; i < count; i++, l = l->links[DIAGNOSTIC_LINES].next) {
+		lines[i].line = l;
+		lines[i].index = lineIndex(l, NULL, NULL);
+	}
+	qsort(lines, count, sizeof (LinePosition), comparePositions); /* In line order */
+
+	textString(&t, "{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/publishDiagnostics\",\"params\":{\"uri\":");
+	textJsonString(&t, d->uri);
+	textString(&t, ",\"diagnostics\":[");
+	for (i = 0; i < count; i++) {
+		if (lines[i].line->error)
+			appendDiagnostic(&t, &first, lines[i].line, lines[i].index, 1, lines[i].line->error);
+		if (lines[i].line->warning)
+			appendDiagnostic(&t, &first, lines[i].line, lines[i].index, 2, lines[i].line->warning);
+	}
+	textString(&t, "]}}");
+	sendMessage(&t);
+	free(lines);
+}
+
+Document *findDocument(const char *params) {
+	Document *d;
+	char *uri = jsonString(jsonGet(params, "textDocument", "uri", NULL));
+	for (d = documents; d && uri && strcmp(d->uri, uri); d = d->next);
+	free(uri);
+	if (d)
+		activate(d);
+	return d;
+}
+
+/* Deletes the lines of tree 't', without updating the document */
+void deleteTree(DocLine *t) {
+	if (t) {
+		deleteTree(t->left);
+		deleteTree(t->right);
+		deleteLine(t);
+	}
+}
+
+void closeDocument(Document *d) {
+	Document **walk;
+	Definition *def;
+	Reference *r;
+	int i;
+	for (walk = &documents; *walk != d; walk = &(*walk)->next);
+	*walk = d->next;
+	deleteTree(d->root);
+	for (i = 0; i < NAME_BUCKETS; i++) {
+		while ((def = d->definitions[i])) {
+			d->definitions[i] = def->next;
+			free(def->name);
+			free(def);
+		}
+		while ((r = d->references[i])) {
+			d->references[i] = r->next;
+			free(r->name);
+			free(r);
+		}
+	}
+	if (active == d) {
+		deleteTable(CODE | DATA | EXTERNAL | ENTRY);
+		active = NULL;
+	}
+	free(d->uri);
+	free(d);
+}
+
+/* Replaces the whole text of a document */
+void setText(Document *d, const char *text, NameList *changed) {
+	reparse(d, 0, spliceLines(d, 0, lineCount(d), text, changed), changed);
+}
+
+void didOpen(const char *params, NameList *changed) {
+	Document *d = (Document *) allocate(NULL, sizeof (Document));
+	char *text;
+	memset(d, 0, sizeof (Document));
+	d->firstResized = INT_MAX;
+	if (!(d->uri = jsonString(jsonGet(params, "textDocument", "uri", NULL))) ||
+			!(text = jsonString(jsonGet(params, "textDocument", "text", NULL)))) {
+		free(d->uri);
+		free(d);
+		return;
+	}
+	d->next = documents;
+	documents = d;
+	activate(d);
+	setText(d, text, changed);
+	free(text);
+	publishDiagnostics(d, 0);
+}
+
+/* Applies the edits of a change notification, reparsing only the edited lines and the lines they affect */
+void didChange(const char *params, NameList *changed) {
+	Document *d;
+	const char *change, *range;
+	char *text, *joined;
+	DocLine *start, *end;
+	int i, startLine, startChar, endLine, endChar, count;
+
+	if (!(d = findDocument(params)))
+		return;
+	for (i = 0; (change = jsonElement(jsonMember(params, "contentChanges"), i)); i++) {
+		if (!(text = jsonString(jsonMember(change, "text"))))
+			continue;
+		if (!(range = jsonMember(change, "range"))) { /* Whole document */
+			setText(d, text, changed);
+			free(text);
+			continue;
+		}
+		startLine = (int) jsonNumber(jsonGet(range, "start", "line", NULL));
+		startChar = (int) jsonNumber(jsonGet(range, "start", "character", NULL));
+		endLine = (int) jsonNumber(jsonGet(range, "end", "line", NULL));
+		endChar = (int) jsonNumber(jsonGet(range, "end", "character", NULL));
+		count = lineCount(d);
+		startLine = startLine < 0 ? 0 : startLine < count ? startLine : count - 1;
+		endLine = endLine < startLine ? startLine : endLine < count ? endLine : count - 1;
+		start = lineAt(d, startLine);
+		end = lineAt(d, endLine);
+		startChar = startChar < 0 ? 0 : startChar < (int) strlen(start->text) ? startChar : (int) strlen(start->text);
+		endChar = endChar < 0 ? 0 : endChar < (int) strlen(end->text) ? endChar : (int) strlen(end->text);
+
+		/* The edited lines become: start of first line, new text, rest of last line */
+		joined = (char *) allocate(NULL, startChar + strlen(text) + strlen(end->text + endChar) + 1);
+		memcpy(joined, start->text, startChar);
+		strcpy(joined + startChar, text);
+		strcat(joined, end->text + endChar);
+		reparse(d, startLine, spliceLines(d, startLine, endLine - startLine + 1, joined, changed), changed);
+		free(joined);
+		free(text);
+	}
+	publishDiagnostics(d, 0);
+}
+
+/* Returns the label under the position in 'params', or NULL */
+char *wordAt(Document *d, const char *params, DocLine **l) {
+	int line = (int) jsonNumber(jsonGet(params, "position", "line", NULL));
+	int character = (int) jsonNumber(jsonGet(params, "position", "character", NULL));
+	const char *text, *start, *end;
+	if (line < 0 || line >= lineCount(d))
+		return NULL;
+	*l = lineAt(d, line);
+	text = (*l)->text;
+	if (character < 0 || character > (int) strlen(text))
+		return NULL;
+	for (start = text + character; start > text && isalnum((unsigned char) start[-1]); start--);
+	for (end = text + character; isalnum((unsigned char) *end); end++);
+	return end > start ? copyString(start, end - start) : NULL;
+}
+
+/* Responds with the location of the label's definition */
+void definition(const char *id, const char *params) {
+	Document *d;
+	DocLine *l;
+	Definition *def = NULL;
+	Text t = {NULL, 0, 0};
+	char *word = NULL;
+	int index;
+	if ((d = findDocument(params)) && (word = wordAt(d, params, &l)) && (def = lookupDefinition(d, word))) {
+		index = lineIndex(def->line, NULL, NULL);
+		textString(&t, "{\"uri\":");
+		textJsonString(&t, d->uri);
+		textPrintf(&t, ",\"range\":{\"start\":{\"line\":%d,\"character\":0},\"end\":{\"line\":%d,\"character\":%ld}}}",
+				index, index, (long) strlen(def->line->text));
+		respond(id, t.s);
+		free(t.s);
+	}
+	else
+		respond(id, "null");
+	free(word);
+}
+
+/* Responds with the address of the label under the position, or of the line */
+void hover(const char *id, const char *params) {
+	Document *d;
+	DocLine *l;
+	Definition *def;
+	Text t = {NULL, 0, 0}, message = {NULL, 0, 0};
+	char *word = NULL;
+	long codeSize, code, data;
+
+	if ((d = findDocument(params))) {
+		codeSize = d->root ? d->root->codeSum : 0;
+		if ((word = wordAt(d, params, &l)) && (def = lookupDefinition(d, word))) {
+			lineIndex(def->line, &code, &data);
+			if (def->attribute & EXTERNAL)
+				textPrintf(&message, "%s: external", def->name);
+			else if (def->attribute & CODE)
+				textPrintf(&message, "%s: code %04ld", def->name, CODE_START + code);
+			else /* Data labels point after the alignment padding */
+				textPrintf(&message, "%s: data %04ld", def->name, CODE_START + codeSize + data + def->line->padding);
+		}
+		else if (word && (l->codeSize || l->dataSize)) {
+			lineIndex(l, &code, &data);
+			textPrintf(&message, "Address %04ld", l->codeSize ? CODE_START + code : CODE_START + codeSize + data + l->padding);
+		}
+	}
+	if (message.s) {
+		textString(&t, "{\"contents\":");
+		textJsonString(&t, message.s);
+		textString(&t, "}");
+		respond(id, t.s);
+		free(t.s);
+	}
+	else
+		respond(id, "null");
+	free(message.s);
+	free(word);
+}
+
+/* Reads the body of the next message from stdin, or returns NULL at end of input */
+char *readMessage(void) {
+	char header[MAX_HEADER], *body;
+	long length = -1;
+	while (fgets(header, MAX_HEADER, stdin)) {
+		if (!strncmp(header, "Content-Length:", 15))
+			length = atol(header + 15);
+		else if ((header[0] == '\r' || header[0] == '\n') && length >= 0) {
+			body = (char *) allocate(NULL, length + 1);
+			body[fread(body, 1, length, stdin)] = '\0';
+			return body;
+		}
+	}
+	return NULL;
+}
+
+/* Serves the language server protocol on stdin and stdout, until 'exit'. Returns non-zero on failure. */
+int runLanguageServer(void) {
+	char *body, *method;
+	const char *id, *params;
+	NameList changed = {NULL, 0, 0};
+	int shutdown = 0;
+
+	if (startCapture()) {
+		fprintf(stderr, "Error: Could not start language server\n");
+		return 1;
+	}
+	setParseOptions(0); /* Options that depend on the whole file are not supported per line */
+
+	while ((body = readMessage())) {
+		method = jsonString(jsonMember(body, "method"));
+		id = jsonMember(body, "id");
+		params = jsonMember(body, "params");
+		if (!method)
+			; /* A response from the client */
+		else if (!strcmp(method, "initialize"))
+			respond(id, "{\"capabilities\":{\"textDocumentSync\":{\"openClose\":true,\"change\":2},"
+					"\"definitionProvider\":true,\"hoverProvider\":true},\"serverInfo\":{\"name\":\"" SOURCE_NAME "\"}}");
+		else if (!strcmp(method, "textDocument/didOpen"))
+			didOpen(params, &changed);
+		else if (!strcmp(method, "textDocument/didChange"))
+			didChange(params, &changed);
+		else if (!strcmp(method, "textDocument/didClose") && findDocument(params)) {
+			publishDiagnostics(active, 1);
+			closeDocument(active);
+		}
+		else if (!strcmp(method, "textDocument/definition") && id)
+			definition(id, params);
+		else if (!strcmp(method, "textDocument/hover") && id)
+			hover(id, params);
+		else if (!strcmp(method, "shutdown") && id) {
+			shutdown = 1;
+			respond(id, "null");
+		}
+		else if (!strcmp(method, "exit")) {
+			free(method);
+			free(body);
+			break;
+		}
+		else if (id) {
+			Text t = {NULL, 0, 0};
+			textString(&t, "{\"jsonrpc\":\"2.0\",\"id\":");
+			textAppend(&t, id, jsonSkip(id) - id);
+			textString(&t, ",\"error\":{\"code\":-32601,\"message\":\"Method not found\"}}");
+			sendMessage(&t);
+		}
+		free(method);
+		free(body);
+	}
+
+	while (documents)
+		closeDocument(documents);
+	free(changed.names);
+	return !shutdown;
+}
@@ -1,4 +1,5 @@
 #include <stdlib.h>
+#include <string.h>
 
 #include "memoryImage.h"
 
@@ -15,6 +16,11 @@ void imageExtend(enum Images imageNumber, enum Type size) {
 	memoryImage[imageNumber].size += size;
 }
 
+/* Increase initial size of memory image by 'count' items of 'size' bytes at once */
+void imageReserve(enum Images imageNumber, enum Type size, int count) {
+	memoryImage[imageNumber].size += size * count;
+}
+
 /* Return current size of memory image */
 int imageSize(enum Images imageNumber) {
 	return memoryImage[imageNumber].size;
@@ -31,7 +37,7 @@ int imageAllocate(void) {
 		!(memoryImage[CODE_IMAGE].pos = memoryImage[CODE_IMAGE].image = (unsigned char *) malloc(memoryImage[CODE_IMAGE].size)))
 		return 1;
 	if (memoryImage[DATA_IMAGE].size > 0 && 
-			!(memoryImage[DATA_IMAGE].pos = memoryImage[DATA_IMAGE].image = (unsigned char *) malloc(memoryImage[DATA_IMAGE].size))) {
+			!(memoryImage[DATA_IMAGE].pos = memoryImage[DATA_IMAGE].image = (unsigned char *) calloc(memoryImage[DATA_IMAGE].size, 1))) { /* Zeroed, so zero fills can be skipped */
 		free(memoryImage[CODE_IMAGE].image);
 		return 1;
 	}
@@ -48,16 +54,72 @@ void imageDelete(void) {
 		free(memoryImage[DATA_IMAGE].image);
 		memoryImage[DATA_IMAGE].image = NULL;
 	}
+	memoryImage[CODE_IMAGE].pos = memoryImage[DATA_IMAGE].pos = NULL;
 	memoryImage[CODE_IMAGE].size = memoryImage[DATA_IMAGE].size = 0;
 }
 
+/* Hands the image array over to the caller, who must free it. The image is left empty. */
+unsigned char *imageRelease(enum Images imageNumber) {
+	unsigned char *image = memoryImage[imageNumber].image;
+	memoryImage[imageNumber].image = memoryImage[imageNumber].pos = NULL;
+	return image;
+}
+
 /* Get the byte from 'imageNumber' on index 'i' */
 unsigned char imageGetByte(enum Images imageNumber, int i) {
 	return memoryImage[imageNumber].image[i];
 }
 
+/* Get 'size' bytes from 'imageNumber' on index 'i', as written by imageWriteBytes */
+unsigned long imageGetBytes(enum Images imageNumber, int i, int size) {
+	unsigned long value = 0;
+	while (size-- > 0)
+		value = (value << CHAR_BIT) | memoryImage[imageNumber].image[i + size];
+	return value;
+}
+
+/* Overwrite 'size' bytes on index 'i' with the long 'from' */
+void imageSetBytes(enum Images imageNumber, int i, long from, int size) {
+	unsigned char *pos = memoryImage[imageNumber].pos;
+	memoryImage[imageNumber].pos = memoryImage[imageNumber].image + i;
+	imageWriteBytes(imageNumber, from, size);
+	memoryImage[imageNumber].pos = pos;
+}
+
+/* Shrink the memory image to its first 'size' bytes */
+void imageTruncate(enum Images imageNumber, int size) {
+	if (size < memoryImage[imageNumber].size) {
+		memoryImage[imageNumber].size = size;
+		if (imageCurrent(imageNumber) > size)
+			memoryImage[imageNumber].pos = memoryImage[imageNumber].image + size;
+	}
+}
+
 /* Write 'size' bytes from the long 'from' to the memory image */
 void imageWriteBytes(enum Images imageNumber, long from, int size) {
 	for (; 0 < size && size <= sizeof from; size--, from >>= CHAR_BIT)
 		*memoryImage[imageNumber].pos++ = from & 0xFF;
 }
+
+/* Write 'length' bytes from 'from' to the memory image at once */
+void imageWriteArray(enum Images imageNumber, const char *from, int length) {
+	memcpy(memoryImage[imageNumber].pos, from, length);
+	memoryImage[imageNumber].pos += length;
+}
+
+/* Write 'count' copies of the low 'size' bytes of 'value' to the memory image */
+void imageFill(enum Images imageNumber, long value, int size, int count) {
+	unsigned char *start = memoryImage[imageNumber].pos;
+	int total = size * count, done;
+
+	if (total <= 0)
+		return;
+	if (value == 0 && imageNumber == DATA_IMAGE) { /* Data image is allocated zeroed, only move the position */
+		memoryImage[imageNumber].pos += total;
+		return;
+	}
+	imageWriteBytes(imageNumber, value, size); /* Write first copy of the pattern */
+	for (done = size; done < total; done *= 2) /* Double the written pattern until the run is filled */
+		memcpy(start + done, start, done < total - done ? done : total - done);
+	memoryImage[imageNumber].pos = start + total;
+}
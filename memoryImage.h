@@ -9,6 +9,9 @@ enum Type {BYTE = 1, HALF = 2, WORD = 4};
 /* Increase initial size of memory image */
 void imageExtend(enum Images imageNumber, enum Type size);
 
+/* Increase initial size of memory image by 'count' items of 'size' bytes at once */
+void imageReserve(enum Images imageNumber, enum Type size, int count);
+
 /* Return current size of memory image */
 int imageSize(enum Images imageNumber);
 
@@ -18,6 +21,24 @@ int imageCurrent(enum Images imageNumber);
 /* Write 'size' bytes from the long 'from' to the memory image */
 void imageWriteBytes(enum Images imageNumber, long from, int size);
 
+/* Write 'length' bytes from 'from' to the memory image at once */
+void imageWriteArray(enum Images imageNumber, const char *from, int length);
+
+/* Write 'count' copies of the low 'size' bytes of 'value' to the memory image */
+void imageFill(enum Images imageNumber, long value, int size, int count);
+
+/* Hands the image array over to the caller, who must free it. The image is left empty. */
+unsigned char *imageRelease(enum Images imageNumber);
+
+/* Get 'size' bytes from 'imageNumber' on index 'i', as written by imageWriteBytes */
+unsigned long imageGetBytes(enum Images imageNumber, int i, int size);
+
+/* Overwrite 'size' bytes on index 'i' with the long 'from' */
+void imageSetBytes(enum Images imageNumber, int i, long from, int size);
+
+/* Shrink the memory image to its first 'size' bytes */
+void imageTruncate(enum Images imageNumber, int size);
+
 /* Get the byte from 'imageNumber' on index 'i' */
 unsigned char imageGetByte(enum Images imageNumber, int i);
 
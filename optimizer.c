@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "symbols.h"
+#include "memoryImage.h"
+#include "instructions.h"
+
+void relocateBuffers(int (*relocate)(int address, int exact));
+
+static unsigned long *words; /* Decoded code image */
+static unsigned char *removed; /* Set for every word to be removed */
+static int *removedBefore; /* Number of removed words before each word, and in total at index wordCount */
+static int wordCount;
+
+/* Returns non-zero if the first two params of 'word' are the same register */
+int sameRegisters(int index, unsigned long word) {
+	long first, second;
+	return instructionParamNumber(index) >= 2 && decodeParam(index, 0, word, &first) == PARAM_REGISTER &&
+			decodeParam(index, 1, word, &second) == PARAM_REGISTER && first == second;
+}
+
+/* Returns non-zero if 'word' can be removed without changing the program, other than through its address */
+int isNoOperation(int index, unsigned long word) {
+	char *name = instructionName(index);
+	long value;
+	if (!strcmp(name, "move"))
+		return sameRegisters(index, word);
+	if (!strcmp(name, "addi") || !strcmp(name, "subi") || !strcmp(name, "ori")) { /* rs, 0, rt */
+		long rs, rt;
+		return findParam(index, word, PARAM_CONSTANT, &value) >= 0 && value == 0 &&
+				decodeParam(index, 0, word, &rs) == PARAM_REGISTER && decodeParam(index, 2, word, &rt) == PARAM_REGISTER && rs == rt;
+	}
+	if (!strcmp(name, "bne") || !strcmp(name, "blt") || !strcmp(name, "bgt")) /* Never taken */
+		return sameRegisters(index, word);
+	return 0;
+}
+
+/* Returns non-zero if 'address' is the address of a word in the code image */
+int isCodeAddress(long address) {
+	return CODE_START <= address && address < CODE_START + (long) wordCount * WORD;
+}
+
+/* Returns the target address of a branch or a jump to a label in word 'i', or -1 if it has none */
+long getTarget(int i) {
+	return instructionTarget(words[i], CODE_START + (long) i * WORD);
+}
+
+/* Returns non-zero if word 'i' is a branch or a jump. Loading or calling an address is not. */
+int isJump(int i) {
+	int index;
+	long value;
+	return (index = decodeInstruction(words[i])) >= 0 && (findParam(index, words[i], PARAM_INTERNAL_LABEL, &value) >= 0 ||
+			!strcmp(instructionName(index), "jmp"));
+}
+
+void countRemoved(void) {
+	int i;
+	for (i = 0, removedBefore[0] = 0; i < wordCount; i++)
+		removedBefore[i + 1] = removedBefore[i] + removed[i];
+}
+
+/* Returns the new address of an old one, after removing words. If 'exact' is set, returns -1 for the address of a removed word. */
+int relocate(int address, int exact) {
+	int i;
+	if (address < CODE_START)
+		return address;
+	if (!isCodeAddress(address))
+		return address - removedBefore[wordCount] * WORD; /* Data moves back by the removed size */
+	i = (address - CODE_START) / WORD;
+	if (exact && removed[i])
+		return -1;
+	return address - removedBefore[i] * WORD; /* A removed word's address becomes that of the next kept word */
+}
+
+void relocateSymbol(Symbol *s) {
+	s->value = relocate(s->value + CODE_START, 0) - CODE_START;
+}
+
+/* Replaces always taken branches with jumps, and makes jumps to jumps go straight to the final target */
+void threadJumps(int jmpIndex) {
+	int i, index, steps;
+	long target, next;
+	for (i = 0; i < wordCount; i++) {
+		if ((index = decodeInstruction(words[i])) >= 0 && !strcmp(instructionName(index), "beq") && sameRegisters(index, words[i]))
+			words[i] = encodeParam(jmpIndex, 0, encodeInstruction(jmpIndex), getTarget(i));
+		if (decodeInstruction(words[i]) != jmpIndex || (target = getTarget(i)) < 0)
+			continue;
+		for (steps = 0; steps < wordCount && isCodeAddress(target); steps++) { /* Bounded, in case jumps form a loop */
+			if (decodeInstruction(words[(target - CODE_START) / WORD]) != jmpIndex || (next = getTarget((target - CODE_START) / WORD)) < 0)
+				break;
+			target = next;
+		}
+		words[i] = encodeParam(jmpIndex, 0, words[i], target);
+	}
+}
+
+/* Removes no-ops and branches to the next kept word, from the code image. Labels, entries, external uses and the line table are
+ * relocated accordingly. Returns the number of removed instructions, or -1 on memory failure. */
+int optimizeCode(void) {
+	int i, j, index, param, changed, total;
+	long target, value;
+	Symbol *jmp;
+
+	wordCount = imageSize(CODE_IMAGE) / WORD;
+	words = (unsigned long *) malloc((wordCount + 1) * sizeof (unsigned long));
+	removed = (unsigned char *) calloc(wordCount + 1, 1);
+	removedBefore = (int *) malloc((wordCount + 1) * sizeof (int));
+	if (!(words && removed && removedBefore && (jmp = lookupSymbol("jmp")))) {
+		free(words);
+		free(removed);
+		free(removedBefore);
+		return -1;
+	}
+
+	for (i = 0; i < wordCount; i++)
+		words[i] = imageGetBytes(CODE_IMAGE, i * WORD, WORD);
+	threadJumps(jmp->value);
+	for (i = 0; i < wordCount; i++)
+		removed[i] = (index = decodeInstruction(words[i])) >= 0 && isNoOperation(index, words[i]);
+
+	do { /* Removing words can make more branches go to the next kept word */
+		countRemoved();
+		changed = 0;
+		for (i = 0; i < wordCount; i++) {
+			if (!removed[i] && isJump(i) && (target = getTarget(i)) >= CODE_START && target <= CODE_START + (long) wordCount * WORD &&
+					relocate((int) target, 0) == relocate(CODE_START + i * WORD, 0) + WORD)
+				removed[i] = changed = 1;
+		}
+	} while (changed);
+
+	/* Re-encode label params with new addresses, and compact the image */
+	for (i = j = 0; i < wordCount; i++) {
+		if (removed[i])
+			continue;
+		if ((index = decodeInstruction(words[i])) >= 0) {
+			if ((param = findParam(index, words[i], PARAM_INTERNAL_LABEL, &value)) >= 0)
+				words[i] = encodeParam(index, param, words[i], relocate((int) getTarget(i), 0) - relocate(CODE_START + i * WORD, 0));
+			else if ((param = findParam(index, words[i], PARAM_ANY_LABEL, &value)) >= 0)
+				words[i] = encodeParam(index, param, words[i], relocate((int) value, 0));
+		}
+		imageSetBytes(CODE_IMAGE, j++ * WORD, (long) words[i], WORD);
+	}
+	imageTruncate(CODE_IMAGE, j * WORD);
+
+	forEachSymbol(CODE, relocateSymbol);
+	relocateBuffers(relocate);
+
+	total = removedBefore[wordCount];
+	free(words);
+	free(removed);
+	free(removedBefore);
+	return total;
+}
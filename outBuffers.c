@@ -1,69 +1,672 @@
+#define _POSIX_C_SOURCE 200112L /* vsnprintf */
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <pthread.h>
 
 #include "symbols.h"
 #include "memoryImage.h"
+#include "assembler.h"
+#include "checksum.h"
+#include "analyzer.h"
+#include "trace.h"
 
 #define OUT_EXTENS ".ob"
 #define ENT_EXTENS ".ent"
 #define EXT_EXTENS ".ext"
+#define MAP_EXTENS ".map"
+#define MAP_TEXT_EXTENS ".map.txt"
+#define CRC_EXTENS ".crc"
+#define ANALYSIS_TEXT_EXTENS ".analysis.txt"
+#define ANALYSIS_JSON_EXTENS ".analysis.json"
+#define MAP_MAGIC "AMAP"
+#define MAP_VERSION 1
 
 #define BYTES_PER_ROW 4
+#define MAX_QUEUED 4 /* Maximum assembled files waiting to be written */
+#define MAX_OUT_LINE 128 /* Longest text printed at once to an output without allocating */
+#define READ_CHUNK 4096
 
-FILE *createOutFile(const char *filename, const char *extension);
+char *copyBasename(const char *filename);
+FILE *createOutFile(const char *basename, const char *extension);
+FILE *openOutFile(const char *basename, const char *extension);
+void bufferMapSymbol(Symbol *copy);
 
 static Symbol *buffers[2]; /* For ext symbols and ent symbols */
+static int outputOptions; /* OutputOption flags */
+
+/* An address in the image, and the source line that wrote it */
+typedef struct MapLine {
+	int address;
+	int lineNumber;
+} MapLine;
+
+static Symbol *mapSymbols; /* Code and data symbols, for the map */
+static MapLine *mapLines; /* Line table, for the map */
+static int mapLineCount, mapLineCapacity;
+
+/* A completed file, waiting to be written to its output files */
+typedef struct OutJob {
+	char *basename; /* Output filename, without extension */
+	unsigned char *images[2]; /* Code and data images */
+	int sizes[2]; /* Sizes of code and data images */
+	Symbol *buffers[2]; /* ext symbols and ent symbols */
+	Symbol *mapSymbols;
+	MapLine *mapLines;
+	int mapLineCount;
+	char *messages; /* Errors and warnings while writing, printed by the main thread */
+	int messagesLength;
+	int failed; /* Set if an output could not be written */
+	struct OutJob *next;
+} OutJob;
+
+/* An output file being written. When writing only changed outputs, the content is kept in memory until it is compared. */
+typedef struct OutFile {
+	FILE *f; /* The file written to, or NULL while kept in memory */
+	char *text; /* Content kept in memory */
+	long length, capacity;
+	unsigned long crc; /* Checksum of the content so far */
+	const char *extension;
+	OutJob *job; /* The job it is written for */
+	int failed; /* Set if some of the content could not be kept in memory or formatted */
+	double start; /* For tracing */
+} OutFile;
+
+static struct {
+	int running; /* Whether the writer thread was started */
+	int closing; /* Set when no more jobs will be queued */
+	int count; /* Number of queued jobs */
+	OutJob *head, *tail;
+	OutJob *done, *doneTail; /* Written jobs, whose messages were not printed yet */
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+} queue;
+
+/* Deletes a list of buffered symbols */
+void deleteBuffer(Symbol *list) {
+	Symbol *tmp;
+	while ((tmp = list) != NULL) {
+		list = list->next;
+		free(tmp);
+	}
+}
+
+/* Returns the final address of a buffered symbol */
+int symbolAddress(Symbol *s, int codeSize) {
+	return s->value + CODE_START + (hasAttribute(s, DATA) ? codeSize : 0);
+}
+
+static int outputFailed; /* Set if an output could not be written, since the last outputFinish */
+
+/* Records a message for 'job', printed later by the main thread. 'error' marks the job as failed. */
+void jobMessage(OutJob *job, int error, const char *format, ...) {
+	char *tmp;
+	int length;
+	va_list ap;
+	job->failed |= error;
+	va_start(ap, format);
+	length = vsnprintf(NULL, 0, format, ap);
+	va_end(ap);
+	if (length < 0 || !(tmp = (char *) realloc(job->messages, job->messagesLength + length + 1)))
+		return;
+	va_start(ap, format);
+	vsnprintf(tmp + job->messagesLength, length + 1, format, ap);
+	va_end(ap);
+	job->messages = tmp;
+	job->messagesLength += length;
+}
+
+/* Prints the messages of a written job, and deletes it */
+void reportJob(OutJob *job) {
+	if (job->messages)
+		fputs(job->messages, stdout);
+	outputFailed |= job->failed;
+	free(job->messages);
+	free(job->basename);
+	free(job);
+}
+
+/* Starts writing the output file with 'extension'. Returns non-zero if it could not be created. */
+int outOpen(OutFile *o, OutJob *job, const char *extension) {
+	o->text = NULL;
+	o->length = o->capacity = 0;
+	o->crc = 0;
+	o->extension = extension;
+	o->job = job;
+	o->failed = 0;
+	o->start = traceClock();
+	if (outputOptions & OUTPUT_IF_CHANGED) { /* Kept in memory, until compared with the existing file */
+		o->f = NULL;
+		return 0;
+	}
+	if (!(o->f = createOutFile(job->basename, extension))) {
+		jobMessage(job, 1, "Error: Could not create output file '%s%s'\n", job->basename, extension);
+		return 1;
+	}
+	return 0;
+}
+
+/* Writes 'length' bytes from 'data' to an output file */
+void outWrite(OutFile *o, const void *data, long length) {
+	char *tmp;
+	if (outputOptions & (OUTPUT_CHECKSUM | OUTPUT_IF_CHANGED))
+		o->crc = checksum(o->crc, (const unsigned char *) data, length);
+	if (o->f) {
+		fwrite(data, 1, length, o->f);
+		o->length += length;
+		return;
+	}
+	if (o->failed)
+		return;
+	if (o->length + length > o->capacity) {
+		o->capacity = (o->capacity ? o->capacity * 2 : READ_CHUNK) + length;
+		if (!(tmp = (char *) realloc(o->text, o->capacity))) {
+			o->failed = 1; /* Reported by outClose */
+			return;
+		}
+		o->text = tmp;
+	}
+	memcpy(o->text + o->length, data, length);
+	o->length += length;
+}
+
+/* Prints formatted text to an output file. Text longer than MAX_OUT_LINE is formatted into an allocated buffer. */
+void outPrintf(OutFile *o, const char *format, ...) {
+	char line[MAX_OUT_LINE], *text = line;
+	int length;
+	va_list ap;
+	va_start(ap, format);
+	length = vsnprintf(line, MAX_OUT_LINE, format, ap);
+	va_end(ap);
+	if (length >= MAX_OUT_LINE) {
+		if ((text = (char *) malloc(length + 1))) {
+			va_start(ap, format);
+			vsnprintf(text, length + 1, format, ap);
+			va_end(ap);
+		}
+	}
+	if (length < 0 || !text) {
+		o->failed = 1; /* Reported by outClose */
+		return;
+	}
+	outWrite(o, text, length);
+	if (text != line)
+		free(text);
+}
+
+/* Returns non-zero if the existing output file has the same content as 'o' */
+int outUnchanged(OutFile *o) {
+	FILE *f;
+	char chunk[READ_CHUNK];
+	long length = 0, read;
+	int same = 1;
+	if (!(f = openOutFile(o->job->basename, o->extension)))
+		return 0;
+	while (same && (read = (long) fread(chunk, 1, READ_CHUNK, f)) > 0) {
+		same = length + read <= o->length && !memcmp(o->text + length, chunk, read);
+		length += read;
+	}
+	fclose(f);
+	return same && length == o->length;
+}
+
+/* Finishes writing an output file. When writing only changed outputs, an identical existing file is left untouched.
+ * The checksum is recorded in 'sums', unless it is NULL. */
+void outClose(OutFile *o, OutFile *sums) {
+	if (o->failed)
+		jobMessage(o->job, 1, o->f ? "Error: Output file '%s%s' is incomplete, could not allocate required memory\n" :
+				"Error: Could not write output file '%s%s', could not allocate required memory\n", o->job->basename, o->extension);
+	if (o->failed && sums)
+		jobMessage(o->job, 1, "Error: '%s%s' is missing from '%s" CRC_EXTENS "'\n", o->job->basename, o->extension, o->job->basename);
+	if (o->f)
+		fclose(o->f);
+	else if (!o->failed && !outUnchanged(o)) {
+		if ((o->f = createOutFile(o->job->basename, o->extension))) {
+			fwrite(o->text, 1, o->length, o->f);
+			fclose(o->f);
+		}
+		else
+			jobMessage(o->job, 1, "Error: Could not create output file '%s%s'\n", o->job->basename, o->extension);
+	}
+	if (sums && !o->failed)
+		outPrintf(sums, "%s %08lX %ld\n", o->extension + 1, o->crc, o->length);
+	free(o->text);
+	traceSpan("output", o->extension, o->start);
+}
+
+/* Writes a list of buffered symbols with their final addresses */
+void writeSymbols(OutFile *o, Symbol *list, int codeSize) {
+	for (; list; list = list->next)
+		outPrintf(o, "%s %04d\n", list->name, symbolAddress(list, codeSize));
+}
+
+/* Writes 'value' as 4 little endian bytes */
+void writeWord(OutFile *o, unsigned long value) {
+	unsigned char bytes[WORD];
+	int i;
+	for (i = 0; i < WORD; i++, value >>= 8)
+		bytes[i] = (unsigned char) (value & 0xFF);
+	outWrite(o, bytes, WORD);
+}
+
+static int mapCodeSize; /* Code size of the map being sorted */
+
+int compareSymbols(const void *a, const void *b) {
+	return symbolAddress(*(Symbol **) a, mapCodeSize) - symbolAddress(*(Symbol **) b, mapCodeSize);
+}
+
+int compareLines(const void *a, const void *b) {
+	return ((const MapLine *) a)->address - ((const MapLine *) b)->address;
+}
+
+/* Writes the symbol map and line table, sorted by address. The binary form is a header of 4 byte fields: magic "AMAP", version,
+ * symbol count, line count, name table size. Then fixed records of symbols (address, name offset, attribute), lines (address, line),
+ * and the names table. All fields are little endian, so records can be binary searched in place. */
+void writeMap(OutJob *job, OutFile *sums) {
+	OutFile map;
+	Symbol **sorted, *tmp;
+	int i, count = 0, nameOffset = 0;
+
+	for (tmp = job->mapSymbols; tmp; tmp = tmp->next)
+		count++;
+	if (!(sorted = (Symbol **) malloc((count ? count : 1) * sizeof (Symbol *)))) {
+		jobMessage(job, 0, "Warn: Could not allocate required memory\n");
+		return;
+	}
+	for (i = 0, tmp = job->mapSymbols; tmp; tmp = tmp->next)
+		sorted[i++] = tmp;
+	mapCodeSize = job->sizes[CODE_IMAGE]; /* Only the writing thread sorts */
+	qsort(sorted, count, sizeof (Symbol *), compareSymbols);
+	qsort(job->mapLines, job->mapLineCount, sizeof (MapLine), compareLines);
+
+	if ((outputOptions & OUTPUT_MAP) && !outOpen(&map, job, MAP_EXTENS)) {
+		outWrite(&map, MAP_MAGIC, strlen(MAP_MAGIC));
+		writeWord(&map, MAP_VERSION);
+		writeWord(&map, count);
+		writeWord(&map, job->mapLineCount);
+		for (i = 0; i < count; i++)
+			nameOffset += strlen(sorted[i]->name) + 1;
+		writeWord(&map, nameOffset);
+		for (i = nameOffset = 0; i < count; nameOffset += strlen(sorted[i++]->name) + 1) {
+			writeWord(&map, symbolAddress(sorted[i], mapCodeSize));
+			writeWord(&map, nameOffset);
+			writeWord(&map, sorted[i]->attribute & (CODE | DATA));
+		}
+		for (i = 0; i < job->mapLineCount; i++) {
+			writeWord(&map, job->mapLines[i].address);
+			writeWord(&map, job->mapLines[i].lineNumber);
+		}
+		for (i = 0; i < count; i++)
+			outWrite(&map, sorted[i]->name, strlen(sorted[i]->name) + 1);
+		outClose(&map, sums);
+	}
+	if ((outputOptions & OUTPUT_MAP_TEXT) && !outOpen(&map, job, MAP_TEXT_EXTENS)) {
+		outPrintf(&map, "symbols %d\n", count);
+		for (i = 0; i < count; i++)
+			outPrintf(&map, "%04d %s %s\n", symbolAddress(sorted[i], mapCodeSize), hasAttribute(sorted[i], CODE) ? "code" : "data", sorted[i]->name);
+		outPrintf(&map, "lines %d\n", job->mapLineCount);
+		for (i = 0; i < job->mapLineCount; i++)
+			outPrintf(&map, "%04d %d\n", job->mapLines[i].address, job->mapLines[i].lineNumber);
+		outClose(&map, sums);
+	}
+	free(sorted);
+}
+
+/* Totals of the blocks from 'first', up to 'end' address */
+void sumBlocks(Analysis *a, int first, int end, Block *sum) {
+	sum->address = first >= 0 ? a->blocks[first].address : end;
+	sum->count = sum->hazards = sum->depth = sum->loop = 0;
+	sum->cycles = 0;
+	for (; first >= 0 && first < a->blockCount && a->blocks[first].address < end; first++) {
+		sum->count += a->blocks[first].count;
+		sum->cycles += a->blocks[first].cycles;
+		sum->hazards += a->blocks[first].hazards;
+		sum->loop |= a->blocks[first].loop;
+		if (a->blocks[first].depth > sum->depth)
+			sum->depth = a->blocks[first].depth;
+	}
+}
+
+/* Writes the basic blocks, code labels and load-use hazards of the code image, as a text report and as JSON. A label covers the
+ * blocks up to the next label, and its depth is the deepest loop nesting in them. */
+void writeAnalysis(OutJob *job, OutFile *sums) {
+	OutFile text, json;
+	Analysis *a;
+	Block *b, sum;
+	Symbol **labels, *tmp;
+	int i, j, count = 0, end, codeEnd = CODE_START + job->sizes[CODE_IMAGE];
+
+	for (tmp = job->mapSymbols; tmp; tmp = tmp->next)
+		count += hasAttribute(tmp, CODE) && symbolAddress(tmp, 0) < codeEnd;
+	labels = (Symbol **) malloc((count ? count : 1) * sizeof (Symbol *));
+	if (!labels || !(a = analyzeCode(job->images[CODE_IMAGE], job->sizes[CODE_IMAGE], job->mapSymbols))) {
+		jobMessage(job, 0, "Warn: Could not allocate required memory\n");
+		free(labels);
+		return;
+	}
+	for (i = 0, tmp = job->mapSymbols; tmp; tmp = tmp->next)
+		if (hasAttribute(tmp, CODE) && symbolAddress(tmp, 0) < codeEnd)
+			labels[i++] = tmp;
+	mapCodeSize = 0; /* Only the writing thread sorts */
+	qsort(labels, count, sizeof (Symbol *), compareSymbols);
+
+	if (!outOpen(&text, job, ANALYSIS_TEXT_EXTENS)) {
+		outPrintf(&text, "instructions %d  cycles %ld  hazards %d  blocks %d\n", a->count, a->cycles, a->hazardCount, a->blockCount);
+		outPrintf(&text, "\nblocks\n");
+		for (i = 0; i < a->blockCount; i++) {
+			b = &a->blocks[i];
+			outPrintf(&text, "%04d  instructions %d  cycles %ld  hazards %d  depth %d  next", b->address, b->count, b->cycles, b->hazards, b->depth);
+			for (j = 0; j < 2; j++)
+				if (b->successors[j] >= 0)
+					outPrintf(&text, " %04d", a->blocks[b->successors[j]].address);
+			outPrintf(&text, "%s%s\n", b->indirect ? " register" : "", b->loop ? "  loop" : "");
+		}
+		outPrintf(&text, "\nlabels\n");
+		for (i = 0; i < count; i = j) {
+			for (j = i + 1; j < count && symbolAddress(labels[j], 0) == symbolAddress(labels[i], 0); j++);
+			end = j < count ? symbolAddress(labels[j], 0) : codeEnd;
+			sumBlocks(a, findBlock(a, symbolAddress(labels[i], 0)), end, &sum);
+			for (; i < j; i++)
+				outPrintf(&text, "%s %04d  instructions %d  cycles %ld  hazards %d  depth %d%s\n", labels[i]->name,
+						sum.address, sum.count, sum.cycles, sum.hazards, sum.depth, sum.loop ? "  loop" : "");
+		}
+		outPrintf(&text, "\nload-use hazards\n");
+		for (i = 0; i < a->hazardCount; i++)
+			outPrintf(&text, "%04d  $%d is used by the next instruction\n", a->hazards[i].address, a->hazards[i].reg);
+		outClose(&text, sums);
+	}
+
+	if (!outOpen(&json, job, ANALYSIS_JSON_EXTENS)) {
+		outPrintf(&json, "{\"instructions\":%d,\"cycles\":%ld,\"hazards\":%d,\"blocks\":[", a->count, a->cycles, a->hazardCount);
+		for (i = 0; i < a->blockCount; i++) {
+			b = &a->blocks[i];
+			outPrintf(&json, "%s\n{\"address\":%d,\"instructions\":%d,\"cycles\":%ld,\"hazards\":%d,\"depth\":%d,\"loop\":%s,\"next\":[",
+					i ? "," : "", b->address, b->count, b->cycles, b->hazards, b->depth, b->loop ? "true" : "false");
+			for (j = 0; j < 2; j++)
+				if (b->successors[j] >= 0)
+					outPrintf(&json, "%s%d", j && b->successors[0] >= 0 ? "," : "", a->blocks[b->successors[j]].address);
+			outPrintf(&json, "],\"register\":%s}", b->indirect ? "true" : "false");
+		}
+		outPrintf(&json, "],\"labels\":[");
+		for (i = 0; i < count; i = j) {
+			for (j = i + 1; j < count && symbolAddress(labels[j], 0) == symbolAddress(labels[i], 0); j++);
+			end = j < count ? symbolAddress(labels[j], 0) : codeEnd;
+			sumBlocks(a, findBlock(a, symbolAddress(labels[i], 0)), end, &sum);
+			for (; i < j; i++) {
+				outPrintf(&json, "%s\n{\"name\":\"%s\",", i ? "," : "", labels[i]->name); /* Label names need no escaping */
+				outPrintf(&json, "\"address\":%d,\"instructions\":%d,\"cycles\":%ld,\"hazards\":%d,\"depth\":%d}",
+						sum.address, sum.count, sum.cycles, sum.hazards, sum.depth);
+			}
+		}
+		outPrintf(&json, "],\"loadUse\":[");
+		for (i = 0; i < a->hazardCount; i++)
+			outPrintf(&json, "%s\n{\"address\":%d,\"register\":%d}", i ? "," : "", a->hazards[i].address, a->hazards[i].reg);
+		outPrintf(&json, "]}\n");
+		outClose(&json, sums);
+	}
+
+	free(labels);
+	deleteAnalysis(a);
+}
+
+/* Writes a completed job to its output files, and deletes what was written. Messages are kept for reportJob. */
+void writeJob(OutJob *job) {
+	OutFile ext, ent, out, sums, *p_sums = NULL;
+	int i, codeSize = job->sizes[CODE_IMAGE];
+	double start = traceClock();
+
+	if ((outputOptions & OUTPUT_CHECKSUM) && !outOpen(&sums, job, CRC_EXTENS)) /* Checksums of the other outputs */
+		p_sums = &sums;
+
+	/* Open files, write, close */
+	if (job->buffers[0] && !outOpen(&ext, job, EXT_EXTENS)) { /* Externals file */
+		writeSymbols(&ext, job->buffers[0], codeSize);
+		outClose(&ext, p_sums);
+	}
+	if (job->buffers[1] && !outOpen(&ent, job, ENT_EXTENS)) { /* Entry file */
+		writeSymbols(&ent, job->buffers[1], codeSize);
+		outClose(&ent, p_sums);
+	}
+	if (!outOpen(&out, job, OUT_EXTENS)) { /* Machine language output */
+		outPrintf(&out, "%d %d", codeSize, job->sizes[DATA_IMAGE]);
+		for (i = 0; i < codeSize + job->sizes[DATA_IMAGE]; i++) {
+			if (i % BYTES_PER_ROW == 0)
+				outPrintf(&out, "\n%04d ", i + CODE_START);
+			outPrintf(&out, "%02X ", i < codeSize ?
+				job->images[CODE_IMAGE][i] : job->images[DATA_IMAGE][i - codeSize]); /* Print byte from code or data image */
+		}
+		outClose(&out, p_sums);
+	}
+	if (outputOptions & (OUTPUT_MAP | OUTPUT_MAP_TEXT))
+		writeMap(job, p_sums);
+	if (outputOptions & OUTPUT_ANALYZE)
+		writeAnalysis(job, p_sums);
+	if (p_sums)
+		outClose(p_sums, NULL);
+
+	for (i = 0; i < 2; i++) {
+		deleteBuffer(job->buffers[i]);
+		free(job->images[i]);
+	}
+	deleteBuffer(job->mapSymbols);
+	free(job->mapLines);
+	traceSpan("writeJob", job->basename, start);
+}
+
+/* Writer thread: writes queued jobs in order until the queue is closed and empty */
+void *writerThread(void *unused) {
+	OutJob *job;
+	traceThread("writer");
+	for (;;) {
+		pthread_mutex_lock(&queue.lock);
+		while (!queue.head && !queue.closing)
+			pthread_cond_wait(&queue.changed, &queue.lock);
+		if (!(job = queue.head)) { /* Closing and nothing left to write */
+			pthread_mutex_unlock(&queue.lock);
+			return NULL;
+		}
+		if (!(queue.head = job->next))
+			queue.tail = NULL;
+		queue.count--;
+		pthread_cond_broadcast(&queue.changed); /* Wake assembler waiting for room */
+		pthread_mutex_unlock(&queue.lock);
+
+		writeJob(job);
+		pthread_mutex_lock(&queue.lock);
+		if (queue.doneTail)
+			queue.doneTail->next = job;
+		else
+			queue.done = job;
+		queue.doneTail = job;
+		job->next = NULL;
+		pthread_mutex_unlock(&queue.lock);
+	}
+}
+
+/* Prints the messages of the jobs written so far by the writer thread, in the order they were queued */
+void reportWritten(void) {
+	OutJob *job, *next;
+	pthread_mutex_lock(&queue.lock);
+	job = queue.done;
+	queue.done = queue.doneTail = NULL;
+	pthread_mutex_unlock(&queue.lock);
+	for (; job; job = next) {
+		next = job->next;
+		reportJob(job);
+	}
+}
+
+/* Sets the outputs, a combination of OutputOption flags, and starts writing them in the background unless OUTPUT_SYNC is set.
+ * Returns non-zero if output will be written synchronously. */
+int outputStart(int options) {
+	outputOptions = options;
+	if (options & (OUTPUT_CHECKSUM | OUTPUT_IF_CHANGED))
+		prepareChecksum();
+	if ((options & OUTPUT_SYNC) || queue.running)
+		return !queue.running;
+	if (pthread_mutex_init(&queue.lock, NULL))
+		return 1;
+	if (pthread_cond_init(&queue.changed, NULL)) {
+		pthread_mutex_destroy(&queue.lock);
+		return 1;
+	}
+	if (pthread_create(&queue.thread, NULL, writerThread, NULL)) {
+		printf("Warn: Could not start output writer, writing synchronously\n");
+		pthread_cond_destroy(&queue.changed);
+		pthread_mutex_destroy(&queue.lock);
+		return 1;
+	}
+	queue.running = 1;
+	return 0;
+}
+
+/* Waits until every queued output has been written, and stops the background writer. Returns non-zero if an output could not be
+ * written. */
+int outputFinish(void) {
+	int failed;
+	if (queue.running) {
+		pthread_mutex_lock(&queue.lock);
+		queue.closing = 1;
+		pthread_cond_broadcast(&queue.changed);
+		pthread_mutex_unlock(&queue.lock);
+		pthread_join(queue.thread, NULL);
+		reportWritten();
+		pthread_cond_destroy(&queue.changed);
+		pthread_mutex_destroy(&queue.lock);
+		queue.running = queue.closing = 0;
+	}
+	failed = outputFailed;
+	outputFailed = 0;
+	return failed;
+}
 
 /* Deletes internal buffers storing data to be written to output. If error is 0, flushes the data into the output files. */
 void flushBuffers(int error, char *filename) {
-	FILE *ext, *ent, *out;
-	Symbol *tmp;
+	OutJob *job = NULL;
 	int i;
+	double start = traceClock(), wait;
 
 	if (!error) {
-		/* Open files, write, close */
-		if (buffers[0] && (ext = createOutFile(filename, EXT_EXTENS))) { /* Externals file */
-			for (tmp = buffers[0]; tmp ; tmp = tmp->next)
-				fprintf(ext, "%s %04d\n", tmp->name, tmp->value + CODE_START + (hasAttribute(tmp, DATA) ? imageSize(CODE_IMAGE) : 0));
-			fclose(ext);
-		}
-		if (buffers[1] && (ent = createOutFile(filename, ENT_EXTENS))) { /* Entry file */
-			for (tmp = buffers[1]; tmp ; tmp = tmp->next)
-				fprintf(ent, "%s %04d\n", tmp->name, tmp->value + CODE_START + (hasAttribute(tmp, DATA) ? imageSize(CODE_IMAGE) : 0));
-			fclose(ent);
-		}
-		if ((out = createOutFile(filename, OUT_EXTENS))) { /* Machine language output */
-			fprintf(out, "%d %d", imageSize(CODE_IMAGE), imageSize(DATA_IMAGE));
-			for (i = 0; i < imageSize(CODE_IMAGE) + imageSize(DATA_IMAGE); i++) {
-				if (i % BYTES_PER_ROW == 0)
-					fprintf(out, "\n%04d ", i + CODE_START);
-				fprintf(out, "%02X ", i < imageSize(CODE_IMAGE) ? 
-					imageGetByte(CODE_IMAGE, i) : imageGetByte(DATA_IMAGE, i - imageSize(CODE_IMAGE))); /* Print byte from code or data image */
+		if (outputOptions & (OUTPUT_MAP | OUTPUT_MAP_TEXT | OUTPUT_ANALYZE)) /* The analysis starts blocks at code labels */
+			forEachSymbol(CODE | DATA, bufferMapSymbol);
+		if ((job = (OutJob *) malloc(sizeof(OutJob))) && (job->basename = copyBasename(filename))) {
+			for (i = 0; i < 2; i++) { /* Take over the images and buffers, so the next file can be assembled meanwhile */
+				job->sizes[i] = imageSize((enum Images) i);
+				job->images[i] = imageRelease((enum Images) i);
+				job->buffers[i] = buffers[i];
+				buffers[i] = NULL;
 			}
-			fclose(out);
+			job->mapSymbols = mapSymbols;
+			job->mapLines = mapLines;
+			job->mapLineCount = mapLineCount;
+			mapSymbols = NULL;
+			mapLines = NULL;
+			job->messages = NULL;
+			job->messagesLength = job->failed = 0;
+			job->next = NULL;
+		}
+		else {
+			printf("Error: Could not allocate required memory\n");
+			free(job);
+			job = NULL;
 		}
 	}
 
+	if (queue.running)
+		reportWritten(); /* Messages of the previous files, before this file is queued */
+	if (job && queue.running) {
+		pthread_mutex_lock(&queue.lock);
+		if (queue.count >= MAX_QUEUED) {
+			wait = traceClock();
+			while (queue.count >= MAX_QUEUED) /* Wait for room in the queue */
+				pthread_cond_wait(&queue.changed, &queue.lock);
+			traceSpan("queueWait", filename, wait);
+		}
+		if (queue.tail)
+			queue.tail->next = job;
+		else
+			queue.head = job;
+		queue.tail = job;
+		queue.count++;
+		pthread_cond_broadcast(&queue.changed);
+		pthread_mutex_unlock(&queue.lock);
+	}
+	else if (job) {
+		writeJob(job);
+		reportJob(job);
+	}
+
 	/* Delete buffers */
 	for (i = 0; i < sizeof buffers / sizeof (Symbol *); i++) {
-		while ((tmp = buffers[i]) != NULL) {
-			buffers[i] = buffers[i]->next;
-			free(tmp);
-		}
+		deleteBuffer(buffers[i]);
+		buffers[i] = NULL;
 	}
+	deleteBuffer(mapSymbols);
+	free(mapLines);
+	mapSymbols = NULL;
+	mapLines = NULL;
+	mapLineCount = mapLineCapacity = 0;
+	traceSpan("flushBuffers", filename, start);
 }
 
-/* Buffer a symbol to be written to output. */
-void buffer(Symbol *copy) {
+/* Adds a copy of a symbol to the start of 'list'. The name is copied along, since the symbol table may be deleted before writing. */
+void bufferTo(Symbol **list, Symbol *copy) {
 	Symbol *tmp;
-	int bufnum = hasAttribute(copy, EXTERNAL) ? 0 : 1;
-	if ((tmp = (Symbol *) malloc(sizeof(Symbol)))) {
+	if ((tmp = (Symbol *) malloc(sizeof(Symbol) + strlen(copy->name) + 1))) {
 		*tmp = *copy;
-		tmp->next = buffers[bufnum];
-		buffers[bufnum] = tmp;
+		tmp->name = strcpy((char *) (tmp + 1), copy->name); /* Name is stored right after the symbol */
+		tmp->next = *list;
+		*list = tmp;
 	}
 	else {
 		printf("Error: Could not allocate required memory\n");
 		exit(1);
 	}
 }
+
+/* Buffer a symbol to be written to output. */
+void buffer(Symbol *copy) {
+	bufferTo(&buffers[hasAttribute(copy, EXTERNAL) ? 0 : 1], copy);
+}
+
+/* Buffer a code or data symbol to be written to the map */
+void bufferMapSymbol(Symbol *copy) {
+	bufferTo(&mapSymbols, copy);
+}
+
+/* Moves buffered addresses after code was removed. 'relocate' returns the new address of an old one, or -1 if 'exact' is set 
+ * and the instruction at the address was removed. */
+void relocateBuffers(int (*relocate)(int address, int exact)) {
+	Symbol *tmp;
+	int i, j, address;
+	for (i = 0; i < sizeof buffers / sizeof (Symbol *); i++) /* Extern uses and code entries are offsets in the code image */
+		for (tmp = buffers[i]; tmp; tmp = tmp->next)
+			if (!hasAttribute(tmp, DATA))
+				tmp->value = relocate(tmp->value + CODE_START, 0) - CODE_START;
+	for (i = j = 0; i < mapLineCount; i++) /* Lines of removed instructions are dropped */
+		if ((address = relocate(mapLines[i].address, 1)) >= 0) {
+			mapLines[j].address = address;
+			mapLines[j++].lineNumber = mapLines[i].lineNumber;
+		}
+	mapLineCount = j;
+}
+
+/* Buffer the address of a source line to be written to the map */
+void bufferLine(int address, int lineNumber) {
+	MapLine *tmp;
+	if (!(outputOptions & (OUTPUT_MAP | OUTPUT_MAP_TEXT)))
+		return;
+	if (mapLineCount == mapLineCapacity) {
+		mapLineCapacity = mapLineCapacity ? mapLineCapacity * 2 : 64;
+		if (!(tmp = (MapLine *) realloc(mapLines, mapLineCapacity * sizeof (MapLine)))) {
+			printf("Error: Could not allocate required memory\n");
+			exit(1);
+		}
+		mapLines = tmp;
+	}
+	mapLines[mapLineCount].address = address;
+	mapLines[mapLineCount++].lineNumber = lineNumber;
+}
@@ -0,0 +1,105 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "stringPool.h"
+
+#define HASHSIZE 211
+
+/* A pooled string suffix, including its terminator */
+typedef struct PoolEntry {
+	char *s;
+	int length; /* Length excluding terminator */
+	int offset; /* Offset of the suffix in the data image */
+	int owner; /* Set if 's' was allocated for this entry, and not shared with a longer string */
+	struct PoolEntry *next; /* next entry in chain */
+} PoolEntry;
+
+static PoolEntry *hashtab[HASHSIZE];
+
+static unsigned char *placements; /* Whether each pooled string was new, in the order pooled */
+static int placementCount, placementCapacity, placementNext;
+
+/* hash: form hash value for 'length' characters (Uses an SDBM Hash) */
+unsigned hashString(const char *s, int length) {
+	unsigned hashval;
+	for (hashval = 0; length > 0; s++, length--)
+		hashval = (unsigned char) *s + (hashval << 6) + (hashval << 16) - hashval;
+	return hashval % HASHSIZE;
+}
+
+PoolEntry *lookupString(const char *s, int length) {
+	PoolEntry *e;
+	for (e = hashtab[hashString(s, length)]; e != NULL; e = e->next)
+		if (e->length == length && !memcmp(s, e->s, length))
+			return e;
+	return NULL;
+}
+
+/* Records whether a pooled string was new. Returns non-zero on memory failure. */
+int addPlacement(int isNew) {
+	unsigned char *tmp;
+	if (placementCount == placementCapacity) {
+		placementCapacity = placementCapacity ? placementCapacity * 2 : 64;
+		if (!(tmp = (unsigned char *) realloc(placements, placementCapacity)))
+			return 1;
+		placements = tmp;
+	}
+	placements[placementCount++] = isNew;
+	return 0;
+}
+
+/* Pools the string 's' of 'length' characters, to be placed at data image 'offset' if new. Returns the offset of an identical 
+ * earlier string or of an earlier string ending with it, POOL_NEW if the string was added, or POOL_ERROR on memory failure. */
+int poolString(const char *s, int length, int offset) {
+	PoolEntry *e;
+	char *copy;
+	unsigned hashval;
+	int i;
+
+	if ((e = lookupString(s, length)))
+		return addPlacement(0) ? POOL_ERROR : e->offset;
+
+	if (!(copy = (char *) malloc(length + 1)))
+		return POOL_ERROR;
+	memcpy(copy, s, length);
+	copy[length] = '\0';
+	for (i = 0; i <= length; i++) { /* Every suffix can be shared by a later string */
+		if (lookupString(copy + i, length - i))
+			continue; /* An earlier string already provides this suffix */
+		if (!(e = (PoolEntry *) malloc(sizeof(PoolEntry)))) {
+			if (i == 0)
+				free(copy);
+			return POOL_ERROR;
+		}
+		e->s = copy + i;
+		e->length = length - i;
+		e->offset = offset + i;
+		e->owner = i == 0;
+		hashval = hashString(e->s, e->length);
+		e->next = hashtab[hashval];
+		hashtab[hashval] = e;
+	}
+	return addPlacement(1) ? POOL_ERROR : POOL_NEW;
+}
+
+/* Returns non-zero if the next string pooled, in the order they were pooled, was new and should be written */
+int poolNextIsNew(void) {
+	return placementNext < placementCount ? placements[placementNext++] : 1;
+}
+
+/* Deletes all pooled strings */
+void poolDelete(void) {
+	int i;
+	PoolEntry *tmp;
+	for (i = 0; i < HASHSIZE; i++) {
+		while ((tmp = hashtab[i]) != NULL) {
+			hashtab[i] = tmp->next;
+			if (tmp->owner)
+				free(tmp->s);
+			free(tmp);
+		}
+	}
+	free(placements);
+	placements = NULL;
+	placementCount = placementCapacity = placementNext = 0;
+}
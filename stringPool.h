@@ -0,0 +1,16 @@
+#ifndef STRING_POOL
+#define STRING_POOL
+
+enum {POOL_NEW = -1, POOL_ERROR = -2};
+
+/* Pools the string 's' of 'length' characters, to be placed at data image 'offset' if new. Returns the offset of an identical 
+ * earlier string or of an earlier string ending with it, POOL_NEW if the string was added, or POOL_ERROR on memory failure. */
+int poolString(const char *s, int length, int offset);
+
+/* Returns non-zero if the next string pooled, in the order they were pooled, was new and should be written */
+int poolNextIsNew(void);
+
+/* Deletes all pooled strings */
+void poolDelete(void);
+
+#endif
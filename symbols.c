@@ -3,7 +3,7 @@
 
 #include "symbols.h"
 
-#define HASHSIZE 211
+#define HASHSIZE 4093
 
 static Symbol *hashtab[HASHSIZE]; /* pointers table */
 
@@ -52,6 +52,29 @@ Symbol *installSymbol(char *name, int value, enum Attribute attribute) {
 	return sp;
 }
 
+/* Deletes the symbol called name, if found */
+void deleteSymbol(char *name) {
+	Symbol **walk, *tmp;
+	for (walk = &hashtab[hash(name)]; *walk != NULL; walk = &(*walk)->next) {
+		if (!strcmp(name, (*walk)->name)) {
+			*walk = (tmp = *walk)->next;
+			free(tmp->name);
+			free(tmp);
+			return;
+		}
+	}
+}
+
+/* Calls 'f' for every symbol in hashtable that has one of 'attributes' */
+void forEachSymbol(enum Attribute attributes, void (*f)(Symbol *s)) {
+	int i;
+	Symbol *sp;
+	for (i = 0; i < HASHSIZE; i++)
+		for (sp = hashtab[i]; sp != NULL; sp = sp->next)
+			if (sp->attribute & attributes)
+				f(sp);
+}
+
 /* Deletes all entries in hashtable that have one of 'attributes' */
 void deleteTable(enum Attribute attributes) {
 	int i;
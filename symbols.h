@@ -22,6 +22,12 @@ Symbol *lookupSymbol(char *name);
 /* Install a symbol, with a name, value, and attribute. Returns pointer to installed symbol or NULL on memory error. */
 Symbol *installSymbol(char *name, int value, enum Attribute attribute);
 
+/* Deletes the symbol called name, if found */
+void deleteSymbol(char *name);
+
+/* Calls 'f' for every symbol in hashtable that has one of 'attributes' */
+void forEachSymbol(enum Attribute attributes, void (*f)(Symbol *s));
+
 /* Deletes all entries in hashtable that have one of 'attributes' */
 void deleteTable(enum Attribute attributes);
 
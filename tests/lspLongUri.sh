@@ -0,0 +1,34 @@
+#!/bin/sh
+# Language server requests on a document with a long URI must be answered, not overflow a buffer.
+# Usage: tests/lspLongUri.sh [assembler]
+
+ASSEMBLER=${1:-./assembler}
+URI="file:///$(printf '%0400d' 0 | tr 0 a).as"
+
+message() {
+	printf 'Content-Length: %d\r\n\r\n%s' "${#1}" "$1"
+}
+
+OUTPUT=$( {
+	message '{"jsonrpc":"2.0","id":1,"method":"initialize","params":{}}'
+	message '{"jsonrpc":"2.0","method":"textDocument/didOpen","params":{"textDocument":{"uri":"'"$URI"'","text":"LOOP: add $1, $2, $3\n\tjmp LOOP\n"}}}'
+	message '{"jsonrpc":"2.0","id":2,"method":"textDocument/definition","params":{"textDocument":{"uri":"'"$URI"'"},"position":{"line":1,"character":6}}}'
+	message '{"jsonrpc":"2.0","id":3,"method":"textDocument/hover","params":{"textDocument":{"uri":"'"$URI"'"},"position":{"line":1,"character":6}}}'
+	message '{"jsonrpc":"2.0","id":4,"method":"shutdown"}'
+	message '{"jsonrpc":"2.0","method":"exit"}'
+} | "$ASSEMBLER" --lsp)
+STATUS=$?
+
+if [ $STATUS -ne 0 ]; then
+	echo "FAIL: assembler --lsp exited with status $STATUS"
+	exit 1
+fi
+case "$OUTPUT" in
+	*'"id":2,"result":{"uri":"'"$URI"'","range":{"start":{"line":0,'*) ;;
+	*) echo "FAIL: definition did not return the label's line"; exit 1 ;;
+esac
+case "$OUTPUT" in
+	*'"id":3,"result":{"contents":"LOOP: code 0100"}'*) ;;
+	*) echo "FAIL: hover did not return the label's address"; exit 1 ;;
+esac
+echo "PASS: long URI"
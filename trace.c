@@ -0,0 +1,188 @@
+#define _POSIX_C_SOURCE 199309L /* clock_gettime */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "trace.h"
+
+#define MAX_DETAIL 64
+#define MAX_THREAD_NAME 32
+#define FIRST_EVENTS 64
+#define PROCESS_ID 1
+#define CATEGORY "assembler"
+
+/* A completed span */
+typedef struct TraceEvent {
+	const char *name; /* Static text, needing no escaping */
+	char detail[MAX_DETAIL];
+	double start, duration; /* Microseconds since tracing started */
+} TraceEvent;
+
+/* Spans of a single thread. Only that thread adds to it, so recording takes no lock. */
+typedef struct TraceBuffer {
+	int id; /* Thread id in the trace */
+	char name[MAX_THREAD_NAME];
+	TraceEvent *events;
+	int count, capacity;
+	int dropped; /* Spans lost on memory failure */
+	struct TraceBuffer *next;
+} TraceBuffer;
+
+static int tracing; /* Set while recording */
+static char *traceFilename;
+static struct timespec origin;
+static pthread_key_t bufferKey; /* Buffer of the calling thread */
+static pthread_mutex_t buffersLock; /* Only taken when a thread records its first span */
+static TraceBuffer *buffers;
+static int threadCount;
+
+/* Starts recording spans, to be written to 'filename' by traceFinish. Returns non-zero on failure. */
+int traceStart(const char *filename) {
+	if (tracing)
+		return 0;
+	if (!(traceFilename = (char *) malloc(strlen(filename) + 1)))
+		return 1;
+	strcpy(traceFilename, filename);
+	if (pthread_key_create(&bufferKey, NULL)) {
+		free(traceFilename);
+		return 1;
+	}
+	if (pthread_mutex_init(&buffersLock, NULL)) {
+		pthread_key_delete(bufferKey);
+		free(traceFilename);
+		return 1;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &origin);
+	tracing = 1;
+	return 0;
+}
+
+/* Returns the time a span starts, or 0 when not tracing */
+double traceClock(void) {
+	struct timespec now;
+	if (!tracing)
+		return 0;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - origin.tv_sec) * 1e6 + (now.tv_nsec - origin.tv_nsec) / 1e3;
+}
+
+/* Returns the buffer of the calling thread, creating it on first use, or NULL on memory failure */
+TraceBuffer *threadBuffer(void) {
+	TraceBuffer *b;
+	if ((b = (TraceBuffer *) pthread_getspecific(bufferKey)))
+		return b;
+	if (!(b = (TraceBuffer *) calloc(1, sizeof (TraceBuffer))))
+		return NULL;
+	pthread_mutex_lock(&buffersLock);
+	b->id = ++threadCount;
+	b->next = buffers;
+	buffers = b;
+	pthread_mutex_unlock(&buffersLock);
+	sprintf(b->name, "thread %d", b->id);
+	pthread_setspecific(bufferKey, b);
+	return b;
+}
+
+/* Records a span called 'name', from 'start' as returned by traceClock until now, on the calling thread. 'detail' may be NULL. */
+void traceSpan(const char *name, const char *detail, double start) {
+	TraceBuffer *b;
+	TraceEvent *e;
+	if (!tracing || !(b = threadBuffer()))
+		return;
+	if (b->count == b->capacity) {
+		if (!(e = (TraceEvent *) realloc(b->events, (b->capacity ? b->capacity * 2 : FIRST_EVENTS) * sizeof (TraceEvent)))) {
+			b->dropped++;
+			return;
+		}
+		b->events = e;
+		b->capacity = b->capacity ? b->capacity * 2 : FIRST_EVENTS;
+	}
+	e = &b->events[b->count++];
+	e->name = name;
+	strncpy(e->detail, detail ? detail : "", MAX_DETAIL - 1);
+	e->detail[MAX_DETAIL - 1] = '\0';
+	e->start = start;
+	e->duration = traceClock() - start;
+}
+
+/* Names the calling thread in the trace */
+void traceThread(const char *name) {
+	TraceBuffer *b;
+	if (tracing && (b = threadBuffer())) {
+		strncpy(b->name, name, MAX_THREAD_NAME - 1);
+		b->name[MAX_THREAD_NAME - 1] = '\0';
+	}
+}
+
+/* Writes 'text' as a JSON string */
+void writeJsonString(FILE *f, const char *text) {
+	fputc('"', f);
+	for (; *text; text++) {
+		if (*text == '"' || *text == '\\')
+			fprintf(f, "\\%c", *text);
+		else if ((unsigned char) *text < ' ')
+			fprintf(f, "\\u%04x", (unsigned char) *text);
+		else
+			fputc(*text, f);
+	}
+	fputc('"', f);
+}
+
+/* Writes the spans of every thread to the trace file, in Chrome trace event format. Must be called after every other thread
+ * that recorded spans has finished. Returns non-zero on failure. */
+int traceFinish(void) {
+	FILE *f;
+	TraceBuffer *b;
+	TraceEvent *e;
+	int i, dropped = 0, error = 0;
+
+	if (!tracing)
+		return 0;
+	tracing = 0;
+	if ((f = fopen(traceFilename, "w"))) {
+		fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+		for (b = buffers; b; b = b->next) {
+			fprintf(f, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":", b == buffers ? "" : ",",
+					PROCESS_ID, b->id);
+			writeJsonString(f, b->name);
+			fprintf(f, "}}");
+			for (i = 0, e = b->events; i < b->count; i++, e++) {
+				fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"" CATEGORY "\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d",
+						e->name, e->start, e->duration, PROCESS_ID, b->id);
+				if (e->detail[0]) {
+					fprintf(f, ",\"args\":{\"detail\":");
+					writeJsonString(f, e->detail);
+					fprintf(f, "}");
+				}
+				fprintf(f, "}");
+			}
+			dropped += b->dropped;
+		}
+		fprintf(f, "\n]}\n");
+		error = ferror(f);
+		if (fclose(f) || error) {
+			printf("Error: Could not write trace file '%s'\n", traceFilename);
+			error = 1;
+		}
+		if (dropped)
+			printf("Warn: %d trace spans were lost, could not allocate required memory\n", dropped);
+	}
+	else {
+		printf("Error: Could not create trace file '%s'\n", traceFilename);
+		error = 1;
+	}
+
+	while ((b = buffers)) {
+		buffers = b->next;
+		free(b->events);
+		free(b);
+	}
+	threadCount = 0;
+	pthread_key_delete(bufferKey);
+	pthread_mutex_destroy(&buffersLock);
+	free(traceFilename);
+	return error;
+}
@@ -0,0 +1,20 @@
+#ifndef TRACE
+#define TRACE
+
+/* Starts recording spans, to be written to 'filename' by traceFinish. Returns non-zero on failure. */
+int traceStart(const char *filename);
+
+/* Returns the time a span starts, or 0 when not tracing */
+double traceClock(void);
+
+/* Records a span called 'name', from 'start' as returned by traceClock until now, on the calling thread. 'detail' may be NULL. */
+void traceSpan(const char *name, const char *detail, double start);
+
+/* Names the calling thread in the trace */
+void traceThread(const char *name);
+
+/* Writes the spans of every thread to the trace file, in Chrome trace event format. Must be called after every other thread
+ * that recorded spans has finished. Returns non-zero on failure. */
+int traceFinish(void);
+
+#endif